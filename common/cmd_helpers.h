@@ -3,18 +3,20 @@
 
 #include <array>
 #include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/program_options.hpp>
-#include <boost/tokenizer.hpp>
 #include <boost/log/trivial.hpp>
 #include <boost/log/sinks.hpp>
 #include <boost/log/expressions.hpp>
 #include <boost/core/null_deleter.hpp>
 
 #include "helpers.h"
+#include "csv_reader.h"
 
 #ifndef NAN
     static const unsigned long __nan[2] = {0xffffffff, 0x7fffffff};
@@ -31,7 +33,7 @@ namespace cmd
     const size_t ERROR_UNHANDLED_EXCEPTION = 2;
 
 	
-    void configureLogging(bool debug = false)
+    inline void configureLogging(bool debug = false)
     {
         using namespace std;
         using namespace boost::log;
@@ -55,7 +57,7 @@ namespace cmd
         core::get()->add_sink(sink);
     }
 
-    bool isHelpRequest(const bpo::options_description &desc,
+    inline bool isHelpRequest(const bpo::options_description &desc,
                        const bpo::variables_map &vm)
     {
         using namespace std;
@@ -87,12 +89,67 @@ namespace cmd
 	return true;
     }
 
+    /**
+     * Options of the format of the 'input' file, shared by all programs
+     * reading a sample vector.
+     */
+    inline void addInputFormatOptions(bpo::options_description &desc)
+    {
+        using namespace std;
+
+        desc.add_options()
+                ("input-format", bpo::value<string>()->default_value("mm"),
+                        "Format of the input file: 'mm' (matrix market), or raw "
+                        "little endian integer samples 'i16le' or 'i32le'")
+                ("scale", bpo::value<double>()->default_value(1.0),
+                        "Factor the raw integer samples are multiplied with")
+                ("offset", bpo::value<double>()->default_value(0.0),
+                        "Value added to the scaled raw integer samples");
+    }
+
+    inline bool isValidInputFormat(const bpo::variables_map &vm)
+    {
+        using namespace std;
+
+        auto format = vm["input-format"].as<string>();
+        if (format != "mm" && format != "i16le" && format != "i32le") {
+            BOOST_LOG_TRIVIAL(error) << "unknown 'input-format' '" << format << "'";
+            return false;
+        }
+
+        return true;
+    }
+
+    template <typename VectorType>
+    bool loadRawVector(const std::string &filename,
+                       const std::string &format,
+                       double scale,
+                       double offset,
+                       VectorType& v)
+    {
+        bool is_loaded = format == "i16le"
+            ? helpers::loadRawVector<std::int16_t>(v, filename, scale, offset)
+            : helpers::loadRawVector<std::int32_t>(v, filename, scale, offset);
+
+        if (! is_loaded) {
+            BOOST_LOG_TRIVIAL(error) << "Error during loading of raw samples "
+                                     << "from file '" << filename << "'";
+            return false;
+        }
+
+        return true;
+    }
+
     template <typename VectorType>
     bool loadInputVector(const bpo::variables_map &vm,
                          VectorType& input)
     {
         using namespace std;
 
+        if (vm.count("input-format") && vm["input-format"].as<string>() != "mm")
+            return loadRawVector(vm["input"].as<string>(), vm["input-format"].as<string>(),
+                                 vm["scale"].as<double>(), vm["offset"].as<double>(), input);
+
         return loadVector(vm["input"].as<string>(), input);
     }
 
@@ -170,7 +227,7 @@ namespace cmd
 	jump_dist_params(2) = 0.0;
     }
 
-    std::shared_ptr<std::ostream> openOutputStream(const bpo::variables_map &vm)
+    inline std::shared_ptr<std::ostream> openOutputStream(const bpo::variables_map &vm)
     {
         using namespace std;
 
@@ -201,66 +258,51 @@ namespace cmd
 	return helpers::saveMMMatrix(output, *os);
     }
 
-    double convertToDouble(const std::string& s)
-    {
-		using namespace std;
-		
-        try
-        {
-            return boost::lexical_cast<double>(s);
-        }
-        catch (boost::bad_lexical_cast const&)
-        {
-            return NAN;
-        }
-    }
-
-    inline bool tryLoadDataAndWeightsLine(const std::string &line,
-            std::pair<double, double>& p)
+    /**
+     * Logs the number and the first line numbers of the rows, which reader
+     * skipped as malformed.
+     */
+    inline void reportMalformedRows(const std::string& filename,
+            const helpers::CsvReader& reader)
     {
         using namespace std;
 
-        boost::char_separator<char> seps(", ");
-        boost::tokenizer<boost::char_separator<char>> tokenizer(line, seps);
-        auto it = tokenizer.begin();
+        if (reader.numMalformedRows() == 0)
+            return;
 
-        auto t1 = *it++;
-        auto t2 = *it;
+        ostringstream lines;
+        for (auto line : reader.malformedLines())
+            lines << " " << line;
+        if (reader.numMalformedRows() > reader.malformedLines().size())
+            lines << " ...";
 
-        boost::algorithm::trim(t1);
-        boost::algorithm::trim(t2);
-
-        p = make_pair(convertToDouble(t1),
-                convertToDouble(t2));
-
-        return true;
+        BOOST_LOG_TRIVIAL(warning) << "Skipped " << reader.numMalformedRows()
+                                   << " malformed rows of '" << filename << "', lines" << lines.str();
     }
 
-    bool tryLoadDataAndWeights(const std::string& filename,
+    inline bool tryLoadDataAndWeights(const std::string& filename,
             std::vector<double>& data,
-            std::vector<double>& weights)
+            std::vector<double>& weights,
+            char delimiter = ',',
+            std::size_t data_column = 0,
+            std::size_t weight_column = 1,
+            int n_threads = 1)
     {
         using namespace std;
 
         data.clear();
         weights.clear();
 
-        ifstream in_file(filename);
-        if (! in_file.is_open()) {
+        helpers::CsvReader reader(delimiter, vector<size_t>{ data_column, weight_column }, n_threads);
+        vector<vector<double>> columns;
+        if (! reader.read(filename, columns)) {
             cerr << "ERROR: Unable to open file '" << filename << "'" << endl;
             return false;
         }
+        reportMalformedRows(filename, reader);
 
-        string current_line;
-        pair<double, double> current_pair;
-        while (getline(in_file, current_line))
-        {
-            if (! tryLoadDataAndWeightsLine(current_line, current_pair))
-                continue;
-
-            data.push_back(get<0>(current_pair));
-            weights.push_back(get<1>(current_pair));
-        }
+        data.swap(columns[0]);
+        weights.swap(columns[1]);
 
         if (data.size() == 0 || weights.size() == 0) {
             cerr << "ERROR: The file '" << filename << "' was empty" << endl;
@@ -270,26 +312,24 @@ namespace cmd
         return true;
     }
 
-    bool tryLoadLabels(const std::string& filename,
-            std::vector<double>& levels)
-
+    inline bool tryLoadLabels(const std::string& filename,
+            std::vector<double>& levels,
+            char delimiter = ',',
+            std::size_t column = 0)
     {
         using namespace std;
 
         levels.clear();
 
-        ifstream in_file(filename);
-        if (! in_file.is_open()) {
+        helpers::CsvReader reader(delimiter, vector<size_t>{ column });
+        vector<vector<double>> columns;
+        if (! reader.read(filename, columns)) {
             cerr << "ERROR: Unable to open file '" << filename << "'" << endl;
             return false;
         }
+        reportMalformedRows(filename, reader);
 
-        string current_line;
-        while (getline(in_file, current_line))
-        {
-            boost::algorithm::trim(current_line);
-            levels.push_back(convertToDouble(current_line));
-        }
+        levels.swap(columns[0]);
 
         if (levels.size() == 0) {
             cerr << "ERROR: The file '" << filename << "' was empty" << endl;
@@ -299,7 +339,7 @@ namespace cmd
         return true;
     }
 
-    bool tryLoadLambdas(const std::string& filename,
+    inline bool tryLoadLambdas(const std::string& filename,
             std::vector<double>& levels)
     {
         return tryLoadLabels(filename, levels);
@@ -0,0 +1,242 @@
+#ifndef CSV_READER_H
+#define CSV_READER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mapped_file.h"
+
+namespace helpers
+{
+    /**
+     * Reads selected columns of numbers from CSV or TSV files. Fields are
+     * separated by the delimiter; spaces and tabs around a field are
+     * ignored, and if the delimiter itself is a space or a tab, runs of it
+     * count as one. Empty lines and lines starting with '#' are skipped.
+     *
+     * A row with too few fields or a field that is no number is malformed.
+     * It is skipped and counted, the line numbers of the first ones are
+     * kept for the error report.
+     *
+     * Large files are split into chunks at line breaks, which are parsed
+     * concurrently. Numbers are converted in place, without allocating
+     * per row.
+     */
+    class CsvReader
+    {
+    public:
+        CsvReader(char delimiter = ',',
+                  std::vector<std::size_t> columns = std::vector<std::size_t>{ 0 },
+                  int n_threads = 1)
+            : m_delimiter(delimiter)
+            , m_columns(columns)
+            , m_n_threads(std::max(n_threads, 1))
+            , m_n_rows(0)
+            , m_n_malformed_rows(0)
+        { }
+
+        /**
+         * Reads the file into one vector per selected column. Returns false,
+         * if the file cannot be opened.
+         */
+        bool read(const std::string &filename,
+                  std::vector<std::vector<double>> &values)
+        {
+            using namespace std;
+
+            MappedFile file;
+            if (! file.open(filename))
+                return false;
+
+            const char *begin = file.data();
+            const char *end = begin + file.size();
+
+            // chunks of at least 1 MiB, ending after a line break
+            const size_t min_chunk_size = 1 << 20;
+            size_t n_chunks = max<size_t>(1, min<size_t>(m_n_threads, file.size() / min_chunk_size));
+
+            vector<const char*> bounds(1, begin);
+            for (size_t i = 1; i < n_chunks; i++) {
+                const char *bound = max(bounds.back(), begin + file.size() * i / n_chunks);
+                bound = static_cast<const char*>(memchr(bound, '\n', end - bound));
+                bounds.push_back(bound ? bound + 1 : end);
+            }
+            bounds.push_back(end);
+
+            vector<Chunk> chunks(n_chunks, Chunk(m_columns.size()));
+            vector<thread> threads;
+            for (size_t i = 1; i < n_chunks; i++)
+                threads.emplace_back(&CsvReader::parseChunk, this, bounds[i], bounds[i+1], ref(chunks[i]));
+            parseChunk(bounds[0], bounds[1], chunks[0]);
+            for (auto &t : threads)
+                t.join();
+
+            // line numbers of the chunks start at 1, shift them behind the
+            // preceding chunks
+            values.assign(m_columns.size(), vector<double>());
+            m_n_rows = 0;
+            m_n_malformed_rows = 0;
+            m_malformed_lines.clear();
+
+            size_t n_lines = 0;
+            for (auto &chunk : chunks) {
+                for (size_t c = 0; c < m_columns.size(); c++)
+                    values[c].insert(values[c].end(), chunk.values[c].begin(), chunk.values[c].end());
+
+                for (auto line : chunk.malformed_lines) {
+                    if (m_malformed_lines.size() < max_reported_lines)
+                        m_malformed_lines.push_back(n_lines + line);
+                }
+
+                m_n_rows += chunk.values.empty() ? 0 : chunk.values[0].size();
+                m_n_malformed_rows += chunk.n_malformed_rows;
+                n_lines += chunk.n_lines;
+            }
+
+            return true;
+        }
+
+        std::size_t numRows() const
+        {
+            return m_n_rows;
+        }
+
+        std::size_t numMalformedRows() const
+        {
+            return m_n_malformed_rows;
+        }
+
+        /**
+         * Line numbers (starting at 1) of the first malformed rows.
+         */
+        const std::vector<std::size_t>& malformedLines() const
+        {
+            return m_malformed_lines;
+        }
+
+        static const std::size_t max_reported_lines = 10;
+
+    private:
+        struct Chunk
+        {
+            explicit Chunk(std::size_t n_columns)
+                : values(n_columns)
+                , n_lines(0)
+                , n_malformed_rows(0)
+            { }
+
+            std::vector<std::vector<double>> values;
+            std::vector<std::size_t> malformed_lines;
+            std::size_t n_lines;
+            std::size_t n_malformed_rows;
+        };
+
+        static bool isBlank(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\r';
+        }
+
+        /**
+         * Converts the field [begin, end) with strtod from a copy on the
+         * stack, as the mapped file is not null terminated.
+         */
+        static bool parseNumber(const char *begin, const char *end, double &value)
+        {
+            char buffer[64];
+            std::size_t length = end - begin;
+            if (length == 0 || length >= sizeof(buffer))
+                return false;
+
+            std::memcpy(buffer, begin, length);
+            buffer[length] = '\0';
+
+            char *parsed_end = nullptr;
+            value = std::strtod(buffer, &parsed_end);
+            return parsed_end == buffer + length;
+        }
+
+        /**
+         * Parses the fields of the line [begin, end) into row. Returns
+         * false, if a selected field is missing or no number.
+         */
+        bool parseLine(const char *begin, const char *end, std::vector<double> &row) const
+        {
+            bool is_blank_delimiter = isBlank(m_delimiter);
+            std::size_t n_found = 0;
+
+            const char *field = begin;
+            for (std::size_t index = 0; field <= end && n_found < m_columns.size(); index++)
+            {
+                while (field < end && isBlank(*field))
+                    field++;
+
+                const char *field_end = field;
+                while (field_end < end && *field_end != m_delimiter && ! (is_blank_delimiter && isBlank(*field_end)))
+                    field_end++;
+
+                const char *value_end = field_end;
+                while (value_end > field && isBlank(value_end[-1]))
+                    value_end--;
+
+                for (std::size_t c = 0; c < m_columns.size(); c++) {
+                    if (m_columns[c] != index)
+                        continue;
+
+                    if (! parseNumber(field, value_end, row[c]))
+                        return false;
+                    n_found++;
+                }
+
+                field = field_end + 1;
+            }
+
+            return n_found == m_columns.size();
+        }
+
+        void parseChunk(const char *begin, const char *end, Chunk &chunk) const
+        {
+            std::vector<double> row(m_columns.size());
+
+            const char *line = begin;
+            while (line < end)
+            {
+                const char *line_end = static_cast<const char*>(std::memchr(line, '\n', end - line));
+                if (! line_end)
+                    line_end = end;
+                chunk.n_lines++;
+
+                const char *first = line;
+                while (first < line_end && isBlank(*first))
+                    first++;
+
+                if (first < line_end && *first != '#') {
+                    if (parseLine(line, line_end, row)) {
+                        for (std::size_t c = 0; c < row.size(); c++)
+                            chunk.values[c].push_back(row[c]);
+                    }
+                    else {
+                        chunk.n_malformed_rows++;
+                        if (chunk.malformed_lines.size() < max_reported_lines)
+                            chunk.malformed_lines.push_back(chunk.n_lines);
+                    }
+                }
+
+                line = line_end + 1;
+            }
+        }
+
+        char m_delimiter;
+        std::vector<std::size_t> m_columns;
+        int m_n_threads;
+        std::size_t m_n_rows;
+        std::size_t m_n_malformed_rows;
+        std::vector<std::size_t> m_malformed_lines;
+    };
+}
+
+#endif // CSV_READER_H
@@ -1,12 +1,18 @@
 #ifndef HELPERS_H
 #define HELPERS_H
 
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <type_traits>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/predef/other/endian.h>
 #include <boost/type_traits/is_complex.hpp>
 
+#include "mapped_file.h"
+
 namespace helpers
 {
     template<typename VectorType>
@@ -198,6 +204,52 @@ namespace helpers
         return true;
     }
 
+    /**
+     * Loads a headerless stream of little endian SampleType integers, e.g.
+     * the raw samples of an ADC, and converts each one to
+     * sample * scale + offset. The file is memory mapped and converted in a
+     * single pass, without an intermediate copy.
+     */
+    template <typename SampleType, typename VectorType>
+    bool loadRawVector(VectorType& vec, std::string filename, double scale, double offset)
+    {
+        using namespace std;
+
+        MappedFile file;
+        if (! file.open(filename))
+            return false;
+
+        if (file.size() % sizeof(SampleType) != 0) {
+            cerr << "The size of '" << filename << "' is no multiple of "
+                 << sizeof(SampleType) << " bytes" << endl;
+            return false;
+        }
+
+        size_t n = file.size() / sizeof(SampleType);
+        vec.resize(n, false);
+
+        const char *bytes = file.data();
+        for (size_t i = 0; i < n; i++)
+        {
+            const char *sample_bytes = bytes + i * sizeof(SampleType);
+            SampleType sample;
+#if BOOST_ENDIAN_LITTLE_BYTE
+            // memcpy instead of a cast, the compiler turns it into a plain
+            // (vectorized) load
+            memcpy(&sample, sample_bytes, sizeof(SampleType));
+#else
+            typedef typename make_unsigned<SampleType>::type UnsignedType;
+            UnsignedType code = 0;
+            for (size_t b = 0; b < sizeof(SampleType); b++)
+                code |= UnsignedType(static_cast<unsigned char>(sample_bytes[b])) << (8 * b);
+            memcpy(&sample, &code, sizeof(SampleType));
+#endif
+            vec[i] = sample * scale + offset;
+        }
+
+        return true;
+    }
+
     template <typename VectorType>
     bool saveMMVector(const VectorType &vec, std::ostream &os)
     {
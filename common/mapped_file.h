@@ -0,0 +1,92 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace helpers
+{
+    /**
+     * Read-only view of a whole file. The file is memory mapped where
+     * possible and read into a buffer otherwise.
+     */
+    class MappedFile
+    {
+    public:
+        MappedFile()
+            : m_data(nullptr)
+            , m_size(0)
+            , m_is_mapped(false)
+        { }
+
+        ~MappedFile()
+        {
+#ifndef _WIN32
+            if (m_is_mapped)
+                munmap(const_cast<char*>(m_data), m_size);
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool open(const std::string &filename)
+        {
+#ifndef _WIN32
+            int fd = ::open(filename.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data != MAP_FAILED) {
+                    m_data = static_cast<const char*>(data);
+                    m_size = st.st_size;
+                    m_is_mapped = true;
+                }
+            }
+            ::close(fd);
+
+            if (m_is_mapped)
+                return true;
+#endif
+            std::ifstream in_file(filename, std::ios::binary);
+            if (! in_file.is_open())
+                return false;
+
+            m_buffer.assign(std::istreambuf_iterator<char>(in_file), std::istreambuf_iterator<char>());
+            m_data = m_buffer.data();
+            m_size = m_buffer.size();
+            return true;
+        }
+
+        const char* data() const
+        {
+            return m_data;
+        }
+
+        std::size_t size() const
+        {
+            return m_size;
+        }
+
+    private:
+        const char *m_data;
+        std::size_t m_size;
+        bool m_is_mapped;
+        std::vector<char> m_buffer;
+    };
+}
+
+#endif // MAPPED_FILE_H
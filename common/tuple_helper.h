@@ -1,8 +1,10 @@
 #ifndef TUPLE_HELPER_H
 #define TUPLE_HELPER_H
 
+#include <algorithm>
 #include <iostream>
 #include <cmath>
+#include <vector>
 
 namespace helpers
 {
@@ -100,17 +102,132 @@ namespace helpers
         }
     }
 
+    /**
+     * Collects (value, length) runs into (data, weight) tuples. A run is
+     * joined with its predecessor if their values differ by no more than
+     * thresh. The collector can be passed directly as segment callback to
+     * TV1D_denoise_segments.
+     */
+    class PlateauCollector
+    {
+    public:
+        PlateauCollector(double thresh = 0.0)
+            : m_thresh(thresh)
+        { }
+
+        void operator()(double value, std::size_t length)
+        {
+            if (! m_data.empty() && std::fabs(value - m_data.back()) <= m_thresh) {
+                m_weights.back() += length;
+                return;
+            }
+
+            m_data.push_back(value);
+            m_weights.push_back(length);
+        }
+
+        std::size_t size() const
+        {
+            return m_data.size();
+        }
+
+        template <typename VectorType>
+        void copyTo(VectorType &data,
+                    VectorType &weights) const
+        {
+            data.resize(m_data.size());
+            weights.resize(m_weights.size());
+
+            std::copy(m_data.begin(), m_data.end(), data.begin());
+            std::copy(m_weights.begin(), m_weights.end(), weights.begin());
+        }
+
+    private:
+        double m_thresh;
+        std::vector<double> m_data;
+        std::vector<double> m_weights;
+    };
+
+    /**
+     * Merges neighbouring plateaus, whose values differ by no more than
+     * tolerance, and plateaus shorter than min_length into the neighbour
+     * with the closer value. A merged plateau has the summed weight and the
+     * weighted mean of the values, so the plateaus still cover every sample.
+     */
+    template <typename VectorType>
+    void mergePlateaus(VectorType &data,
+                       VectorType &weights,
+                       double tolerance,
+                       double min_length)
+    {
+        using namespace std;
+
+        vector<double> near_data, near_weights;
+        for (size_t i = 0; i < data.size(); i++)
+        {
+            if (! near_data.empty() && fabs(data(i) - near_data.back()) <= tolerance) {
+                double weight = near_weights.back() + weights(i);
+                near_data.back() += (data(i) - near_data.back()) * weights(i) / weight;
+                near_weights.back() = weight;
+                continue;
+            }
+
+            near_data.push_back(data(i));
+            near_weights.push_back(weights(i));
+        }
+
+        // a short plateau closer to its successor is carried forward and
+        // merged into it
+        vector<double> merged_data, merged_weights;
+        double carry_value = 0.0, carry_weight = 0.0;
+        size_t n = near_data.size();
+        for (size_t i = 0; i < n; i++)
+        {
+            double value = near_data[i];
+            double weight = near_weights[i];
+            if (carry_weight > 0.0) {
+                value += (carry_value - value) * carry_weight / (weight + carry_weight);
+                weight += carry_weight;
+                carry_weight = 0.0;
+            }
+
+            bool has_prev = ! merged_data.empty();
+            bool has_next = i + 1 < n;
+            if (weight >= min_length || (! has_prev && ! has_next)) {
+                merged_data.push_back(value);
+                merged_weights.push_back(weight);
+            }
+            else if (has_prev && (! has_next || fabs(value - merged_data.back()) <= fabs(value - near_data[i+1]))) {
+                double merged_weight = merged_weights.back() + weight;
+                merged_data.back() += (value - merged_data.back()) * weight / merged_weight;
+                merged_weights.back() = merged_weight;
+            }
+            else {
+                carry_value = value;
+                carry_weight = weight;
+            }
+        }
+
+        data.resize(merged_data.size());
+        weights.resize(merged_weights.size());
+        copy(merged_data.begin(), merged_data.end(), data.begin());
+        copy(merged_weights.begin(), merged_weights.end(), weights.begin());
+    }
+
     template <typename VectorType>
     void postprocessTVDNData(const VectorType &input,
 		    	             VectorType &data,
-			                 VectorType &weights)
+			                 VectorType &weights,
+                             double thresh = 0.0)
     {
 	    using namespace std;
 
-	    VectorType dv;
-	    diff(input, dv);
-	    populateDataAndWeightVectors(input, dv, data, weights);
-        //combineConsecutiveValues(data, weights);
+        // single pass run-length compression of the denoised signal
+        PlateauCollector plateaus(thresh);
+        for (size_t i = 0; i < input.size(); i++)
+            plateaus(input(i), 1);
+
+        plateaus.copyTo(data, weights);
     }
 }
 
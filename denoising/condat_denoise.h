@@ -1,10 +1,18 @@
 #ifndef CONDAT_DENOISE_H
 #define CONDAT_DENOISE_H
 
+#include <algorithm>
 #include <boost/numeric/ublas/vector.hpp>
 namespace ublas = boost::numeric::ublas;
 
-void TV1D_denoise(const double* input, double* output, const int width, const double lambda)
+/**
+ * Condat's direct TV denoising algorithm, which emits the solution segment
+ * by segment. For each plateau emit(value, length) is called in order from
+ * left to right, so callers which are only interested in the (value, length)
+ * runs don't need to materialize and rescan the full-length output.
+ */
+template <typename SegmentFn>
+void TV1D_denoise_segments(const double* input, const int width, const double lambda, SegmentFn&& emit)
 {
     /*to avoid invalid memory access to input[0]*/
 	if (width<=0) 
@@ -23,18 +31,16 @@ void TV1D_denoise(const double* input, double* output, const int width, const do
         while (k == width-1) 
         {	/*we use the right boundary condition*/
             if (umin<0.0) {			/*vmin is too high -> negative jump necessary*/
-                do 
-                    output[k0++]=vmin; 
-                while (k0<=kminus);
+                emit(vmin, kminus-k0+1);
+                k0 = kminus+1;
                 umax = (vmin = input[kminus=k=k0]) + (umin=lambda)-vmax;
             } else if (umax>0.0) {	/*vmax is too low -> positive jump necessary*/
-                do 
-                    output[k0++]=vmax; 
-                while (k0<=kplus);
+                emit(vmax, kplus-k0+1);
+                k0 = kplus+1;
                 umin = (vmax = input[kplus=k=k0])+(umax=minlambda)-vmin;
             } else {
                 vmin += umin / (k-k0+1); 
-                do output[k0++]=vmin; while(k0<=k); 
+                emit(vmin, k-k0+1);
                 return;
             }
         }
@@ -42,9 +48,8 @@ void TV1D_denoise(const double* input, double* output, const int width, const do
         /*negative jump necessary*/
         if ((umin+=input[k+1]-vmin) < minlambda) 
         {		
-            do 
-                output[k0++]=vmin; 
-            while (k0<=kminus);
+            emit(vmin, kminus-k0+1);
+            k0 = kminus+1;
             
             vmax=(vmin=input[kplus=kminus=k=k0])+twolambda;
             umin=lambda; umax=minlambda;
@@ -52,9 +57,8 @@ void TV1D_denoise(const double* input, double* output, const int width, const do
         /*positive jump necessary*/
         else if ((umax+=input[k+1]-vmax) > lambda) 
         {	
-            do 
-                output[k0++] = vmax; 
-            while (k0<=kplus);
+            emit(vmax, kplus-k0+1);
+            k0 = kplus+1;
             
             vmin=(vmax=input[kplus=kminus=k=k0])-twolambda;
             umin=lambda; umax=minlambda;
@@ -75,6 +79,13 @@ void TV1D_denoise(const double* input, double* output, const int width, const do
     }
 }
 
+void TV1D_denoise(const double* input, double* output, const int width, const double lambda)
+{
+    TV1D_denoise_segments(input, width, lambda, [&output](double value, int length) {
+        output = std::fill_n(output, length, value);
+    });
+}
+
 void TV1D_denoise(const ublas::vector<double> &input, ublas::vector<double> &output, const double lambda)
 {
     TV1D_denoise(&input[0], &output[0], input.size(), lambda);
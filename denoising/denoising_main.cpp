@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include <boost/program_options.hpp>
 #include <boost/program_options/parsers.hpp>
 #include <boost/numeric/ublas/vector.hpp>
@@ -10,6 +12,7 @@
 
 #include "helpers.h"
 #include "condat_denoise.h"
+#include "weighted_denoise.h"
 
 namespace bpo = boost::program_options;
 namespace ublas = boost::numeric::ublas;
@@ -32,7 +35,16 @@ namespace
                 ("lambda", bpo::value<double>(),
                         "Lambda coefficient used as regularizer in"
                         "the total-variation denoising problem")
+                ("lambda-profile", bpo::value<string>(),
+                        "Filename of a matrix market vector file containing "
+                        "one lambda per edge (n-1 values) or per sample "
+                        "(n values, an edge uses the mean of its two samples). "
+                        "Replaces 'lambda' for recordings with varying noise level")
+                ("data-weights", bpo::value<string>(),
+                        "Filename of a matrix market vector file containing "
+                        "a positive data weight for each sample")
                 ("debug,d", "Turn on debug output if flag is set");
+        cmd::addInputFormatOptions(desc);
 
         return desc;
     }
@@ -64,13 +76,21 @@ namespace
                 is_valid = false;
             }
 
+            if (! cmd::isValidInputFormat(vm))
+                is_valid = false;
+
             if (! vm.count("output")) {
                 BOOST_LOG_TRIVIAL(error) << "'output' argument is required";
                 is_valid = false;
             }
 
-            if (! vm.count("lambda")) {
-                BOOST_LOG_TRIVIAL(error) << "'lambda' argument is required";
+            if (! vm.count("lambda") && ! vm.count("lambda-profile")) {
+                BOOST_LOG_TRIVIAL(error) << "either 'lambda' or 'lambda-profile' argument is required";
+                is_valid = false;
+            }
+
+            if (vm.count("lambda") && vm.count("lambda-profile")) {
+                BOOST_LOG_TRIVIAL(error) << "'lambda' and 'lambda-profile' are mutually exclusive";
                 is_valid = false;
             }
 
@@ -83,19 +103,116 @@ namespace
         }
     }
 
+    bool isWeightedDenoisingRequest(const bpo::variables_map &vm)
+    {
+        return vm.count("lambda-profile") || vm.count("data-weights");
+    }
+
+    template <typename VectorType>
+    bool loadEdgeLambdas(const bpo::variables_map &vm,
+                         const std::size_t n,
+                         VectorType &lambdas)
+    {
+        using namespace std;
+
+        lambdas.resize(n - 1);
+
+        if (! vm.count("lambda-profile")) {
+            std::fill(lambdas.begin(), lambdas.end(), vm["lambda"].as<double>());
+            return true;
+        }
+
+        VectorType profile;
+        if (! cmd::loadVector(vm["lambda-profile"].as<string>(), profile))
+            return false;
+
+        if (profile.size() == n - 1) {
+            lambdas = profile;
+        }
+        else if (profile.size() == n) {
+            for (size_t k = 0; k < n - 1; k++)
+                lambdas(k) = 0.5 * (profile(k) + profile(k+1));
+        }
+        else {
+            BOOST_LOG_TRIVIAL(error) << "'lambda-profile' has " << profile.size()
+                                     << " elements, expected " << (n - 1)
+                                     << " or " << n;
+            return false;
+        }
+
+        if (std::any_of(lambdas.begin(), lambdas.end(),
+                        [](double l) { return l < 0.0; })) {
+            BOOST_LOG_TRIVIAL(error) << "'lambda-profile' contains negative values";
+            return false;
+        }
+
+        return true;
+    }
+
+    template <typename VectorType>
+    bool loadDataWeights(const bpo::variables_map &vm,
+                         const std::size_t n,
+                         VectorType &weights)
+    {
+        using namespace std;
+
+        if (! vm.count("data-weights")) {
+            weights.resize(n);
+            std::fill(weights.begin(), weights.end(), 1.0);
+            return true;
+        }
+
+        if (! cmd::loadVector(vm["data-weights"].as<string>(), weights))
+            return false;
+
+        if (weights.size() != n) {
+            BOOST_LOG_TRIVIAL(error) << "'data-weights' has " << weights.size()
+                                     << " elements, expected " << n;
+            return false;
+        }
+
+        if (std::any_of(weights.begin(), weights.end(),
+                        [](double w) { return w <= 0.0; })) {
+            BOOST_LOG_TRIVIAL(error) << "'data-weights' must be strictly positive";
+            return false;
+        }
+
+        return true;
+    }
+
+    template <typename VectorType>
+    bool denoiseWeighted(const bpo::variables_map &vm,
+                         const VectorType &input,
+                         VectorType &output)
+    {
+        VectorType lambdas, weights;
+        if (! loadEdgeLambdas(vm, input.size(), lambdas))
+            return false;
+
+        if (! loadDataWeights(vm, input.size(), weights))
+            return false;
+
+        TV1D_denoise_weighted(input, output, lambdas, weights);
+        return true;
+    }
+
     int runProgram(const bpo::options_description& desc,
                    const bpo::variables_map &vm)
     {
         using namespace std;
         typedef boost::numeric::ublas::vector<double> VectorType;
 
-	auto lambda = vm["lambda"].as<double>();
-
         VectorType input, output;
         if (! cmd::loadInputVectorAndAdjustOutputSize(vm, input, output))
             return cmd::ERROR_UNHANDLED_EXCEPTION;
 
-        TV1D_denoise(input, output, lambda);
+        if (isWeightedDenoisingRequest(vm)) {
+            if (! denoiseWeighted(vm, input, output))
+                return cmd::ERROR_UNHANDLED_EXCEPTION;
+        }
+        else {
+            TV1D_denoise(input, output, vm["lambda"].as<double>());
+        }
 
         if (! cmd::saveOutputVector(vm, output))
             return cmd::ERROR_UNHANDLED_EXCEPTION;
@@ -20,6 +20,7 @@ namespace
                 ("lambdamax", "Just output lambda max, "
                               "which is the maximum value of the regulrization parameter")
                 ("debug,d", "Turn on debug output if flag is set");
+        cmd::addInputFormatOptions(desc);
 
         return desc;
     }
@@ -50,6 +51,9 @@ namespace
                 is_valid = false;
             }
 
+            if (! cmd::isValidInputFormat(vm))
+                is_valid = false;
+
             return is_valid;
         }
         catch (bpo::error& e) {
@@ -0,0 +1,136 @@
+#ifndef WEIGHTED_DENOISE_H
+#define WEIGHTED_DENOISE_H
+
+#include <vector>
+#include <boost/numeric/ublas/vector.hpp>
+
+namespace ublas = boost::numeric::ublas;
+
+/**
+ * Weighted total-variation denoising (weighted fused lasso), which minimizes
+ *
+ *   1/2 * sum_i weights[i] * (input[i] - output[i])^2
+ *       + sum_k lambdas[k] * |output[k+1] - output[k]|
+ *
+ * with one data weight per sample (weights[0..width-1], all > 0) and one
+ * regularization coefficient per edge (lambdas[0..width-2]).
+ *
+ * The solver is the exact dynamic programming algorithm of N. Johnson,
+ * "A dynamic programming algorithm for the fused lasso and L0-segmentation"
+ * (2013). The derivative of each forward message is piecewise linear; its
+ * knots are kept in the arrays x/a/b, which grow from the middle to both
+ * sides. tm/tp are the back-pointers (clipping bounds) of each step.
+ * For constant weights and lambdas it yields the same result as
+ * TV1D_denoise.
+ */
+void TV1D_denoise_weighted(const double* input, double* output, const int width,
+                           const double* lambdas, const double* weights)
+{
+    if (width <= 0)
+        return;
+
+    if (width == 1) {
+        output[0] = input[0];
+        return;
+    }
+
+    std::vector<double> x(2*width), a(2*width), b(2*width); /*knots and coefficient increments*/
+    std::vector<double> tm(width-1), tp(width-1);           /*back-pointers*/
+
+    double afirst, bfirst, alast, blast;   /*coefficients left of the first / right of the last knot*/
+    double alo, blo, ahi, bhi;
+    int l, r, lo, hi;
+
+    /*the first step is done manually*/
+    tm[0] = -lambdas[0]/weights[0] + input[0];
+    tp[0] =  lambdas[0]/weights[0] + input[0];
+    l = width-1;
+    r = width;
+    x[l] = tm[0];
+    x[r] = tp[0];
+    a[l] = weights[0];
+    b[l] = -weights[0]*input[0] + lambdas[0];
+    a[r] = -weights[0];
+    b[r] = weights[0]*input[0] + lambdas[0];
+    afirst = weights[1];
+    bfirst = -weights[1]*input[1] - lambdas[0];
+    alast = -weights[1];
+    blast = weights[1]*input[1] - lambdas[0];
+
+    for (int k = 1; k < width-1; k++)
+    {
+        const double lambda = lambdas[k];
+
+        /*step up from l until the derivative is greater than -lambda*/
+        alo = afirst;
+        blo = bfirst;
+        for (lo = l; lo <= r; lo++) {
+            if (alo*x[lo] + blo > -lambda)
+                break;
+            alo += a[lo];
+            blo += b[lo];
+        }
+
+        /*negative knot*/
+        tm[k] = (-lambda - blo)/alo;
+        l = lo-1;
+        x[l] = tm[k];
+
+        /*step down from r until the derivative is less than lambda*/
+        ahi = alast;
+        bhi = blast;
+        for (hi = r; hi >= l; hi--) {
+            if (-ahi*x[hi] - bhi < lambda)
+                break;
+            ahi += a[hi];
+            bhi += b[hi];
+        }
+
+        /*positive knot*/
+        tp[k] = (lambda + bhi)/(-ahi);
+        r = hi+1;
+        x[r] = tp[k];
+
+        /*update the coefficients*/
+        a[l] = alo;
+        b[l] = blo + lambda;
+        a[r] = ahi;
+        b[r] = bhi + lambda;
+        afirst = weights[k+1];
+        bfirst = -weights[k+1]*input[k+1] - lambda;
+        alast = -weights[k+1];
+        blast = weights[k+1]*input[k+1] - lambda;
+    }
+
+    /*the last value is where the derivative of the last message vanishes*/
+    alo = afirst;
+    blo = bfirst;
+    for (lo = l; lo <= r; lo++) {
+        if (alo*x[lo] + blo > 0.0)
+            break;
+        alo += a[lo];
+        blo += b[lo];
+    }
+    output[width-1] = -blo/alo;
+
+    /*follow the back-pointers*/
+    for (int k = width-2; k >= 0; k--)
+    {
+        if (output[k+1] > tp[k])
+            output[k] = tp[k];
+        else if (output[k+1] < tm[k])
+            output[k] = tm[k];
+        else
+            output[k] = output[k+1];
+    }
+}
+
+void TV1D_denoise_weighted(const ublas::vector<double> &input,
+                           ublas::vector<double> &output,
+                           const ublas::vector<double> &lambdas,
+                           const ublas::vector<double> &weights)
+{
+    TV1D_denoise_weighted(&input[0], &output[0], input.size(), &lambdas[0], &weights[0]);
+}
+
+#endif // WEIGHTED_DENOISE_H
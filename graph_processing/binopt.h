@@ -1,17 +1,25 @@
 #ifndef BINOPT_H
 #define BINOPT_H
 
+#include <algorithm>
+#include <chrono>
 #include <functional>
 #include <map>
 #include <iomanip>
 #include <limits>
 #include <memory>
 #include <queue>
+#include <random>
+#include <sstream>
+#include <thread>
 #include <vector>
 
 #include <boost/log/trivial.hpp>
 
 #include "energy.h"
+#include "chain_energy.h"
+#include "maxflow_capture.h"
+#include "checkpoint.h"
 #include "sitesstore.h"
 #include "runtime_statistics.h"
 
@@ -20,40 +28,99 @@ using namespace std;
 template<typename EnergyType = long long,
          typename DataCostFnArgType = int,
          typename SmoothCostFnArgType = int,
-         typename LabelCostFnArgType = int>
+         typename LabelCostFnArgType = int,
+         typename StatisticsPolicy = NoExpansionStatistics,
+         typename ExpansionEnergyType = EnergyGraph<EnergyType>>
 class BinaryOptimization
 {
 public:
     typedef typename EnergyGraph<EnergyType>::VertexDescriptor VertexDescriptor;
     typedef typename EnergyGraph<EnergyType>::EdgeDescriptor EdgeDescriptor;
+    typedef EnergyGraph<EnergyType> EnergyGraphType;
+    typedef typename EnergyGraphType::MaxFlowAlgorithm MaxFlowAlgorithm;
+
+    // The expansion graphs are EnergyGraphs by default. As the sites form
+    // a chain, ChainEnergy can be used instead, which solves them exactly
+    // without a graph.
+    typedef typename ExpansionEnergyType::VertexDescriptor ExpansionVertexDescriptor;
+
+    enum InitializationType { RANDOM, MIN_DATA_COST };
+    enum LabelOrdering { SHUFFLE, DATA_COST_BENEFIT, POPULATION, ROUND_ROBIN };
 
 public:
 
     BinaryOptimization(int n_sites, int n_labels)
         : m_last_expansion_energy(numeric_limits<EnergyType>::max())
+        , m_num_expansions(0)
+        , m_num_bound_skips(0)
+        , m_num_unchanged_skips(0)
+        , m_labeling_version(0)
+        , m_has_deadline(false)
+        , m_is_out_of_time(false)
+        , m_checkpoint_interval(0.0)
+        , m_num_threads(1)
+        , m_label_ordering(SHUFFLE)
+        , m_local_window_radius(0)
+        , m_round_robin_offset(0)
+        , m_random_engine(random_device()())
+        , m_max_flow_algorithm(EnergyGraphType::BOYKOV_KOLMOGOROV)
         , m_record_energy_graph_dumps(false)
         , m_record_energy_history(true)
     {
-        vector<VertexDescriptor> vertex_descs;
-
-        initializeEnergyGraph(n_sites, vertex_descs);
-        initializeSitesStore(vertex_descs);
+        initializeEnergyGraph(m_energy_graph, n_sites, m_vertex_descs);
+        initializeExpansionGraph(m_expansion_graph, n_sites);
+        initializeSitesStore(m_vertex_descs);
         initializeLabelTable(n_labels);
+        m_failed_at_version.assign(n_labels, -1);
+        m_label_gains.assign(n_labels, numeric_limits<EnergyType>::max());
     }
 
     ~BinaryOptimization()
     { }
 
-    EnergyType initiallyAssignLabels()
+    EnergyType initiallyAssignLabels(InitializationType init_type = RANDOM)
     {
         vector<VertexDescriptor> vertices;
         m_sites_store.queryAllVertices(vertices);
 
-        //auto initial_cost = initiallyAssignLabelsByMinDataCost(vertices);
-        auto initial_cost = initallyAssignLabelsRandomly(vertices);
+        if (init_type == MIN_DATA_COST)
+            initiallyAssignLabelsByMinDataCost(vertices);
+        else
+            initallyAssignLabelsRandomly(vertices);
 
+        // The last expansion energy belongs to the replaced labeling
+        m_labeling_version++;
+        m_last_expansion_energy = numeric_limits<EnergyType>::max();
         updateCountingStatistics();
-        return initial_cost;
+        return computeEnergy();
+    }
+
+    /**
+     * Warm start from a given labeling, e.g. from a previous run on the
+     * same data. labels[i] is the label of the i-th site.
+     */
+    EnergyType initiallyAssignLabels(const vector<int>& labels)
+    {
+        vector<VertexDescriptor> vertices;
+        m_sites_store.queryAllVertices(vertices);
+
+        for (auto vertex_desc : vertices)
+        {
+            auto vertex_idx = whichVertexIndex(vertex_desc);
+            auto label = labels[vertex_idx];
+
+            EnergyType cost = 0;
+            if (m_data_cost_fn)
+                cost = safeInvokeCostFn(m_data_cost_fn, make_tuple(vertex_idx, label), 0);
+
+            m_sites_store.assignLabel(vertex_desc, label, cost);
+        }
+
+        // The last expansion energy belongs to the replaced labeling
+        m_labeling_version++;
+        m_last_expansion_energy = numeric_limits<EnergyType>::max();
+        updateCountingStatistics();
+        return computeEnergy();
     }
 
     EnergyType expansion(int max_iterations = 100)
@@ -64,7 +131,10 @@ public:
 
         EnergyType new_energy = -1;
 
-        if (max_iterations < 0) {
+        if (m_local_window_radius > 0) {
+            new_energy = expansionLocalized(max_iterations);
+        }
+        else if (max_iterations < 0) {
             new_energy = expansionConcentratingOnEnergyReducingLabels();
         }
         else {
@@ -78,21 +148,130 @@ public:
         return new_energy;
     }
 
+    /**
+     * Multiresolution variant of expansion(). The first pass only proposes
+     * every coarsest_stride-th label, each following pass halves the stride
+     * and only proposes the labels within the previous stride around the
+     * labels currently in use. Every pass starts from the labeling of the
+     * previous one. The label indices are expected to be ordered by their
+     * level value, as generated by level_generator.
+     */
+    EnergyType expansionCoarseToFine(int coarsest_stride, int max_iterations = 100)
+    {
+        vector<int> all_labels(m_label_table);
+        sort(all_labels.begin(), all_labels.end());
+
+        EnergyType new_energy = -1;
+        int prev_stride = 0;
+
+        for (int stride = max(coarsest_stride, 1); stride > 0; stride /= 2)
+        {
+            if (prev_stride == 0)
+                selectLabelsByStride(all_labels, stride);
+            else
+                selectLabelsAroundAssignments(all_labels, stride, prev_stride);
+
+            BOOST_LOG_TRIVIAL(debug) << "Label stride " << stride << ": proposing "
+                                     << m_label_table.size() << " of "
+                                     << all_labels.size() << " labels";
+
+            new_energy = expansion(max_iterations);
+            prev_stride = stride;
+
+            if (isOutOfTime())
+                break;
+        }
+
+        m_label_table = all_labels;
+        return new_energy;
+    }
+
+    /**
+     * Fusion move: every site either keeps its current label or takes its
+     * label from proposed_labels, chosen jointly by a single min cut. The
+     * proposal can be any labeling, e.g. the result of another run or a
+     * coarse solution. Non-submodular pairs are truncated like in the
+     * expansion, so the fused labeling is only kept if its energy is lower.
+     */
+    EnergyType fuse(const vector<int>& proposed_labels)
+    {
+        updateLabelInformation();
+        EnergyType current_energy = computeEnergy();
+        if (isOutOfTime())
+            return current_energy;
+
+        LabelProposal proposal(proposed_labels);
+        vector<VertexDescriptor> active_sites;
+        collectExpansionSites(proposal, active_sites);
+
+        ExpansionRecord<EnergyType> record;
+        m_last_expansion_energy = current_energy;
+
+        m_num_expansions++;
+        minimizeExpansionGraph(proposal, active_sites, m_expansion_graph, record);
+
+        vector<VertexDescriptor> switching_sites;
+        collectSwitchingSites(m_expansion_graph, active_sites, switching_sites);
+
+        auto previous_labels = whichLabels();
+        auto n_changed = acceptNewLabeling(proposal, switching_sites);
+
+        EnergyType fused_energy = computeEnergy();
+        BOOST_LOG_TRIVIAL(debug) << "Fusion relabeled " << n_changed
+                                 << " sites, energy " << current_energy
+                                 << " -> " << fused_energy;
+
+        if (fused_energy > current_energy) {
+            fused_energy = initiallyAssignLabels(previous_labels);
+            n_changed = 0;
+        }
+
+        record.sites_changed = n_changed;
+        record.energy_delta = fused_energy - current_energy;
+        m_statistics.record(record);
+
+        m_last_expansion_energy = fused_energy;
+        return fused_energy;
+    }
+
+    int numExpansions() const
+    {
+        return m_num_expansions;
+    }
+
+    /**
+     * Number of expansions, which were skipped without a max-flow: by the
+     * gain bound or because the labeling did not change since the label
+     * last failed. They are not counted by numExpansions().
+     */
+    int numSkippedExpansions() const
+    {
+        return m_num_bound_skips + m_num_unchanged_skips;
+    }
+
+    const StatisticsPolicy& statistics() const
+    {
+        return m_statistics;
+    }
+
     BinaryOptimization& setDataCost(function<EnergyType(tuple<int, int>, DataCostFnArgType)> data_cost_fn)
     {
         m_data_cost_fn = data_cost_fn;
+        m_labeling_version++;
         return *this;
     }
 
     BinaryOptimization& setSmoothnessCost(function<EnergyType(tuple<int, int, int, int>, SmoothCostFnArgType)> smooth_cost_fn)
     {
         m_smooth_cost_fn = smooth_cost_fn;
+        m_labeling_version++;
         return *this;
     }
 
     BinaryOptimization& setLabelCost(function<EnergyType (tuple<int, int, int, int>, LabelCostFnArgType)> label_cost_fn)
     {
         m_label_cost_fn = label_cost_fn;
+        m_labeling_version++;
         return *this;
     }
 
@@ -117,11 +296,171 @@ public:
         return assignments;
     }
 
+    /**
+     * Number of alpha expansions of a label sweep which are computed
+     * concurrently, each on a private copy of the energy graph. The
+     * proposals are committed in label order, so the result does not
+     * depend on the thread scheduling.
+     */
+    void setNumThreads(int n_threads)
+    {
+        m_num_threads = max(n_threads, 1);
+    }
+
+    /**
+     * Enables localized sweeps: after a global sweep, only the sites within
+     * radius of a site relabeled by the previous sweep are expanded, all
+     * others keep their label. A global sweep verifies the result, once the
+     * localized sweeps stop relabeling. 0 disables them.
+     */
+    void setLocalWindowRadius(int radius)
+    {
+        m_local_window_radius = max(radius, 0);
+    }
+
+    /**
+     * Stops the optimization, once seconds of wall-clock time have passed
+     * since this call. An expansion is either completed or not started,
+     * so the labeling reached so far is kept. So that a run cut short has
+     * tried the most promising labels, labels which decreased the energy
+     * most at their last expansion are proposed first. 0 or less disables
+     * the budget.
+     */
+    void setTimeBudget(double seconds)
+    {
+        m_has_deadline = seconds > 0.0;
+        m_is_out_of_time = false;
+        if (m_has_deadline)
+            m_deadline = chrono::steady_clock::now()
+                       + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(seconds));
+    }
+
+    /**
+     * Whether the last optimization stopped at the deadline of
+     * setTimeBudget(), before it converged.
+     */
+    bool isTimeBudgetExhausted() const
+    {
+        return m_is_out_of_time;
+    }
+
+    /**
+     * Calls checkpoint_fn with the current state every interval_seconds,
+     * between two expansions. The state is a copy, so the function may
+     * keep it, e.g. to write it on another thread.
+     */
+    void setCheckpointFn(function<void (const OptimizationState&)> checkpoint_fn,
+                         double interval_seconds)
+    {
+        m_checkpoint_fn = checkpoint_fn;
+        m_checkpoint_interval = interval_seconds;
+        m_next_checkpoint = chrono::steady_clock::now()
+                          + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(interval_seconds));
+    }
+
+    void exportState(OptimizationState& state)
+    {
+        auto labels = whichLabels();
+        state.labels.assign(labels.begin(), labels.end());
+        state.label_table.assign(m_label_table.begin(), m_label_table.end());
+        state.num_expansions = m_num_expansions;
+        state.num_bound_skips = m_num_bound_skips;
+        state.num_unchanged_skips = m_num_unchanged_skips;
+        state.round_robin_offset = m_round_robin_offset;
+
+        stringstream random_state;
+        random_state << m_random_engine;
+        state.random_state = random_state.str();
+
+        state.energy_history.clear();
+        for (auto& history : m_runtime_statistics.energyHistory())
+            state.energy_history[history.first].assign(history.second.begin(), history.second.end());
+    }
+
+    /**
+     * Continues from a state of exportState(), e.g. of an interrupted run
+     * on the same data. The label table is only restored, if it holds all
+     * labels. Returns the energy of the restored labeling.
+     */
+    EnergyType restoreState(const OptimizationState& state)
+    {
+        // Only a permutation of all labels replaces the label table, the
+        // per-label vectors are indexed with its entries
+        if (state.label_table.size() == m_label_table.size()
+            && hasDistinctLabels(state.label_table, m_label_table.size()))
+            m_label_table.assign(state.label_table.begin(), state.label_table.end());
+
+        m_num_expansions = state.num_expansions;
+        m_num_bound_skips = state.num_bound_skips;
+        m_num_unchanged_skips = state.num_unchanged_skips;
+        m_round_robin_offset = state.round_robin_offset;
+
+        if (! state.random_state.empty()) {
+            stringstream random_state(state.random_state);
+            random_state >> m_random_engine;
+        }
+
+        typename RuntimeStatistics<std::string, EnergyType>::EnergyHistoryType energy_history;
+        for (auto& history : state.energy_history)
+            energy_history[history.first].assign(history.second.begin(), history.second.end());
+        m_runtime_statistics.setEnergyHistory(energy_history);
+
+        return initiallyAssignLabels(vector<int>(state.labels.begin(), state.labels.end()));
+    }
+
+    void setSeed(uint64_t seed)
+    {
+        m_random_engine.seed(seed);
+    }
+
+    /**
+     * Order in which the labels are proposed in each sweep: randomly
+     * shuffled, by the summed data cost decrease the label offers to the
+     * sites, by the number of sites currently assigned to the label, or
+     * cyclically by label index with a different start label per sweep.
+     */
+    void setLabelOrdering(LabelOrdering ordering)
+    {
+        m_label_ordering = ordering;
+    }
+
+    /**
+     * Max-flow solver of the expansion graphs. All solvers yield the same
+     * cut, so the result does not depend on the choice.
+     */
+    void setMaxFlowAlgorithm(MaxFlowAlgorithm algorithm)
+    {
+        m_max_flow_algorithm = algorithm;
+        m_expansion_graph.energy.setMaxFlowAlgorithm(algorithm);
+        for (auto& graph : m_worker_graphs)
+            graph->energy.setMaxFlowAlgorithm(algorithm);
+    }
+
     void recordEnergyGraphDumps(bool record_dumps = true)
     {
         m_record_energy_graph_dumps = record_dumps;
     }
 
+    /**
+     * Writes the max-flow instance of every expansion to a DIMACS file
+     * starting with prefix, e.g. to compare the max-flow solvers on real
+     * expansion graphs with maxflow_benchmark.
+     */
+    void recordMaxFlowDumps(const string& prefix)
+    {
+        m_max_flow_dump_prefix = prefix;
+    }
+
+    /**
+     * Appends the max-flow instance of every expansion to the binary
+     * capture file file_name, which maxflow_benchmark loads. Returns false,
+     * if the file cannot be written.
+     */
+    bool recordMaxFlowCapture(const string& file_name)
+    {
+        return m_max_flow_capture.open(file_name);
+    }
+
     void recordEnergyHistory(bool record_history = true)
     {
         m_record_energy_history = record_history;
@@ -133,9 +472,67 @@ public:
     }
 
 private:
+    // The binary variables of a move are only the sites, which can change
+    // their label. variables are all variables of the energy, the first
+    // ones are used by the current move. vertices holds the variable of
+    // each site and is_variable, whether the site has one in this move.
+    // variable_sites lists these sites, so the flags are reset in time
+    // linear in the size of the move.
+    struct ExpansionGraph
+    {
+        ExpansionEnergyType energy;
+        vector<ExpansionVertexDescriptor> variables;
+        vector<ExpansionVertexDescriptor> vertices;
+        vector<char> is_variable;
+        vector<int> variable_sites;
+        bool is_truncated;
+    };
+
+    // Sites first to last of the chain, both included
+    struct SiteWindow
+    {
+        int first;
+        int last;
+    };
+
+    // The label a site switches to, if its binary variable is 1: alpha for
+    // an expansion move, the site's label of a proposal labeling for a
+    // fusion move.
+    struct LabelProposal
+    {
+        explicit LabelProposal(int alpha)
+            : alpha_label(alpha)
+            , labels(nullptr)
+        { }
+
+        explicit LabelProposal(const vector<int>& proposed_labels)
+            : alpha_label(-1)
+            , labels(&proposed_labels)
+        { }
+
+        inline int labelOf(int vertex_idx) const
+        {
+            return labels ? (*labels)[vertex_idx] : alpha_label;
+        }
+
+        int alpha_label;
+        const vector<int>* labels;
+    };
+
+    struct ExpansionProposal
+    {
+        int alpha_label;
+        EnergyType energy;
+        vector<VertexDescriptor> switching_sites;
+        ExpansionRecord<EnergyType> record;
+    };
+
     vector<int> m_label_table;
     //vector<int> m_label_costs;
     EnergyGraph<EnergyType> m_energy_graph;
+    vector<VertexDescriptor> m_vertex_descs;
+    ExpansionGraph m_expansion_graph;
+    vector<unique_ptr<ExpansionGraph>> m_worker_graphs;
 
     function<EnergyType (tuple<int, int>, DataCostFnArgType)> m_data_cost_fn;
     function<EnergyType (tuple<int, int, int, int>, SmoothCostFnArgType)> m_smooth_cost_fn;
@@ -144,36 +541,85 @@ private:
     SitesStore<EnergyType, VertexDescriptor, int> m_sites_store;
 
     EnergyType m_last_expansion_energy;
+    int m_num_expansions;
+    int m_num_bound_skips;
+    int m_num_unchanged_skips;
+
+    // Incremented whenever the labeling, the costs or the localized windows
+    // change. A label, whose expansion failed at the current version, fails
+    // again.
+    long m_labeling_version;
+    vector<long> m_failed_at_version;
+
+    // Deadline of setTimeBudget(), once reached no expansion is started.
+    // Until then, the labels are proposed by the energy decrease of their
+    // last expansion, untried ones first.
+    chrono::steady_clock::time_point m_deadline;
+    bool m_has_deadline;
+    bool m_is_out_of_time;
+    vector<EnergyType> m_label_gains;
+
+    function<void (const OptimizationState&)> m_checkpoint_fn;
+    double m_checkpoint_interval;
+    chrono::steady_clock::time_point m_next_checkpoint;
+
+    int m_num_threads;
+    LabelOrdering m_label_ordering;
+
+    // Windows of the current localized sweep, empty in a global one, and
+    // the sites relabeled since the windows were set
+    int m_local_window_radius;
+    vector<SiteWindow> m_local_windows;
+    vector<int> m_relabeled_sites;
+
+    size_t m_round_robin_offset;
+    mt19937_64 m_random_engine;
+    MaxFlowAlgorithm m_max_flow_algorithm;
     RuntimeStatistics<std::string, EnergyType> m_runtime_statistics;
+    StatisticsPolicy m_statistics;
 
     bool m_record_energy_graph_dumps;
     bool m_record_energy_history;
+    string m_max_flow_dump_prefix;
+    MaxFlowCaptureWriter m_max_flow_capture;
+    MaxFlowInstance m_captured_instance;
 
 private:
 
-    void initializeEnergyGraph(const int n_sites,
-                               vector<VertexDescriptor>& vertex_descs)
+    template<typename GraphType>
+    void initializeEnergyGraph(GraphType& energy,
+                               const int n_sites,
+                               vector<typename GraphType::VertexDescriptor>& vertex_descs)
     {
         vertex_descs.clear();
 
         for (int i = 0; i < n_sites; i++)
         {
-            auto v = m_energy_graph.addVariable();
+            auto v = energy.addVariable();
             if (i > 0) {
-                m_energy_graph.addTerm2(v, vertex_descs.back(),
-                                        0, 0, 0, 0);
+                energy.addTerm2(v, vertex_descs.back(),
+                                0, 0, 0, 0);
             }
 
             vertex_descs.push_back(v);
         }
     }
 
+    void initializeExpansionGraph(ExpansionGraph& graph, const int n_sites)
+    {
+        initializeEnergyGraph(graph.energy, n_sites, graph.variables);
+        graph.vertices = graph.variables;
+        graph.is_variable.assign(n_sites, 0);
+        graph.variable_sites.clear();
+        graph.is_truncated = false;
+    }
+
     EnergyType initallyAssignLabelsRandomly(vector<VertexDescriptor>& vertices)
     {
         if (! m_data_cost_fn)
             return -1;
 
-        permuteLabelTable();
+        shuffleLabelTable();
 
         EnergyType initial_cost = 0.0;
         int n = 0;
@@ -190,7 +636,7 @@ private:
             initial_cost += cost;
         }
 
-        return -1;
+        return initial_cost;
     }
 
     EnergyType initiallyAssignLabelsByMinDataCost(vector<VertexDescriptor>& vertices)
@@ -201,8 +647,9 @@ private:
         EnergyType initial_cost = 0.0;
         for (auto vertex_desc : vertices)
         {
-            auto best_label = findMinDataCostLabel(vertex_desc);
-            auto cost = m_data_cost_fn(make_tuple(vertex_desc, best_label), 0);
+            auto vertex_idx = whichVertexIndex(vertex_desc);
+            auto best_label = findMinDataCostLabel(vertex_idx);
+            auto cost = m_data_cost_fn(make_tuple(vertex_idx, best_label), 0);
 
             m_sites_store.assignLabel(vertex_desc, best_label);
             m_sites_store.assignDataCost(vertex_desc, cost);
@@ -228,13 +675,43 @@ private:
             m_label_table.push_back(i);
     }
 
-    int findMinDataCostLabel(VertexDescriptor vertex_desc)
+    void selectLabelsByStride(const vector<int>& all_labels, int stride)
+    {
+        m_label_table.clear();
+        for (size_t i = 0; i < all_labels.size(); i += stride)
+            m_label_table.push_back(all_labels[i]);
+    }
+
+    void selectLabelsAroundAssignments(const vector<int>& all_labels,
+                                       int stride,
+                                       int radius)
+    {
+        const int n_labels = all_labels.size();
+        vector<bool> is_selected(n_labels, false);
+
+        for (auto label : whichLabels())
+        {
+            int first = max(0, label - radius);
+            int last = min(n_labels - 1, label + radius);
+
+            for (int i = first + (stride - first % stride) % stride; i <= last; i += stride)
+                is_selected[i] = true;
+        }
+
+        m_label_table.clear();
+        for (int i = 0; i < n_labels; i++) {
+            if (is_selected[i])
+                m_label_table.push_back(all_labels[i]);
+        }
+    }
+
+    int findMinDataCostLabel(int vertex_idx)
     {
         auto min_cost = std::numeric_limits<EnergyType>::max();
         int min_label = 0;
 
         for (int cur_label : m_label_table) {
-            auto cost = m_data_cost_fn(make_tuple(vertex_desc, cur_label), 0);
+            auto cost = m_data_cost_fn(make_tuple(vertex_idx, cur_label), 0);
             if (cost >= min_cost)
                 continue;
 
@@ -288,21 +765,22 @@ private:
         queue<int> sizes_queue;
         sizes_queue.push(m_label_table.size());
 
-        permuteLabelTable();
         updateLabelInformation();
+        orderLabelTable();
 
         int next_label = 0;
 
-        for (auto cycle = 0; !sizes_queue.empty(); cycle++)
+        for (auto cycle = 0; !sizes_queue.empty() && ! isOutOfTime(); cycle++)
         {
             // Pass over unchecked labels in the current queue
             int start_label = next_label;
             int cycle_size = sizes_queue.back();
             int steps_in_cycle = cycle_size - start_label;
+            prioritizeLabelsByGain(start_label, cycle_size);
 
             do {
                 proposeAlphaLabel(next_label, cycle_size, cycle);
-            } while (next_label < cycle_size);
+            } while (next_label < cycle_size && ! isOutOfTime());
 
             adjustLabelQueue(sizes_queue, next_label, start_label, cycle_size);
         }
@@ -320,22 +798,178 @@ private:
             old_energy = new_energy;
             new_energy = doExpansionIteration(i);
 
-            if (new_energy == old_energy)
+            if (new_energy == old_energy || isOutOfTime())
+                break;
+        }
+
+        return new_energy;
+    }
+
+    /**
+     * Alternates global and localized sweeps: each sweep only expands the
+     * windows around the sites relabeled by the previous one. If there are
+     * none or the windows cover most sites, the sweep is global. The run
+     * ends with a global sweep, which relabels no site, or after
+     * max_iterations sweeps (unlimited, if negative).
+     */
+    EnergyType expansionLocalized(int max_iterations)
+    {
+        EnergyType new_energy = computeEnergy();
+        vector<SiteWindow> windows;
+
+        for (int i = 0; max_iterations < 0 || i < max_iterations; i++)
+        {
+            if (2 * countWindowSites(windows) > m_vertex_descs.size())
+                windows.clear();
+
+            setLocalWindows(windows);
+            m_relabeled_sites.clear();
+
+            if (windows.empty())
+                new_energy = doExpansionIteration(i);
+            else
+                new_energy = doLocalExpansionIteration(i);
+
+            BOOST_LOG_TRIVIAL(debug) << (windows.empty() ? "Global" : "Localized") << " sweep "
+                                     << i << " relabeled " << m_relabeled_sites.size()
+                                     << " sites, energy " << new_energy;
+
+            if ((m_relabeled_sites.empty() && windows.empty()) || isOutOfTime())
                 break;
+
+            windows = collectLocalWindows(m_relabeled_sites);
         }
 
+        setLocalWindows(vector<SiteWindow>());
+        m_relabeled_sites.clear();
         return new_energy;
     }
 
+    /**
+     * Sweep over all labels, which only expands the sites within the
+     * localized windows. The labeling outside the windows is fixed, so a
+     * move costs time linear in the window sizes. The sweep is sequential,
+     * also with several threads.
+     */
+    EnergyType doLocalExpansionIteration(int iter)
+    {
+        orderLabelTable();
+        prioritizeLabelsByGain(0, m_label_table.size());
+        m_last_expansion_energy = computeEnergy();
+
+        int label_iter = 0;
+        for (auto label : m_label_table)
+        {
+            BOOST_LOG_TRIVIAL(debug) << "\t----------------------------";
+            if (isOutOfTime())
+                break;
+
+            BOOST_LOG_TRIVIAL(debug) << "\tIter: " << iter << " (localized)";
+            BOOST_LOG_TRIVIAL(debug) << "\tAttempting label: " << label;
+
+            alphaExpansion(iter, label_iter, label);
+            label_iter++;
+        }
+
+        return m_last_expansion_energy;
+    }
+
+    static size_t countWindowSites(const vector<SiteWindow>& windows)
+    {
+        size_t n_sites = 0;
+        for (auto& window : windows)
+            n_sites += window.last - window.first + 1;
+
+        return n_sites;
+    }
+
+    // Merges the windows of radius m_local_window_radius around the sites,
+    // extended to whole plateaus
+    vector<SiteWindow> collectLocalWindows(vector<int> sites)
+    {
+        sort(sites.begin(), sites.end());
+
+        const int n_sites = m_vertex_descs.size();
+        vector<SiteWindow> windows;
+        for (auto site : sites)
+        {
+            SiteWindow window = { max(site - m_local_window_radius, 0),
+                                  min(site + m_local_window_radius, n_sites - 1) };
+
+            // A plateau cut by the window could only switch in part
+            while (window.first > 0 && labelAt(window.first - 1) == labelAt(window.first))
+                window.first--;
+            while (window.last < n_sites - 1 && labelAt(window.last + 1) == labelAt(window.last))
+                window.last++;
+
+            if (! windows.empty() && window.first <= windows.back().last + 1)
+                windows.back().last = max(windows.back().last, window.last);
+            else
+                windows.push_back(window);
+        }
+
+        return windows;
+    }
+
+    inline int labelAt(int site)
+    {
+        return m_sites_store.whichLabel(m_vertex_descs[site]);
+    }
+
+    void setLocalWindows(const vector<SiteWindow>& windows)
+    {
+        // A failure within the old windows says nothing about the new ones
+        m_local_windows = windows;
+        m_labeling_version++;
+    }
+
+    // Sticky, so a run stops consistently in all nested loops
+    bool isOutOfTime()
+    {
+        if (m_has_deadline && ! m_is_out_of_time && chrono::steady_clock::now() >= m_deadline)
+        {
+            BOOST_LOG_TRIVIAL(debug) << "Time budget exhausted after " << m_num_expansions << " expansions";
+            m_is_out_of_time = true;
+        }
+
+        return m_is_out_of_time;
+    }
+
+    // Only between two expansions, so the labeling is consistent
+    void checkpointIfDue()
+    {
+        if (! m_checkpoint_fn || chrono::steady_clock::now() < m_next_checkpoint)
+            return;
+
+        OptimizationState state;
+        exportState(state);
+        m_checkpoint_fn(state);
+
+        m_next_checkpoint = chrono::steady_clock::now()
+                          + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(m_checkpoint_interval));
+    }
+
     EnergyType doExpansionIteration(int iter)
     {
         updateLabelInformation();
-        permuteLabelTable();
+        orderLabelTable();
+        prioritizeLabelsByGain(0, m_label_table.size());
+
+        if (m_num_threads > 1)
+        {
+            for (size_t first = 0; first < m_label_table.size() && ! isOutOfTime(); first += m_num_threads)
+                doParallelExpansionBatch(iter, first);
+
+            return computeEnergy();
+        }
 
         int label_iter = 0;
         for (auto label : m_label_table)
          {
             BOOST_LOG_TRIVIAL(debug) << "\t----------------------------";
+            if (isOutOfTime())
+                break;
+
             BOOST_LOG_TRIVIAL(debug) << "\tIter: " << iter;
             BOOST_LOG_TRIVIAL(debug) << "\tAttempting label: " << label;
 
@@ -388,53 +1022,519 @@ private:
         }
     }
 
-    void permuteLabelTable()
+    void shuffleLabelTable()
+    {
+        shuffle(m_label_table.begin(), m_label_table.end(), m_random_engine);
+    }
+
+    void orderLabelTable()
+    {
+        switch (m_label_ordering)
+        {
+            case DATA_COST_BENEFIT:
+                orderLabelTableByDataCostBenefit();
+                break;
+            case POPULATION:
+                orderLabelTableByPopulation();
+                break;
+            case ROUND_ROBIN:
+                orderLabelTableRoundRobin();
+                break;
+            default:
+                shuffleLabelTable();
+        }
+    }
+
+    template<typename KeyType>
+    void sortLabelTableDescending(const map<int, KeyType>& keys)
+    {
+        // shuffle first, so labels with equal keys are still tried in a
+        // (seeded) random order
+        shuffleLabelTable();
+        stable_sort(m_label_table.begin(), m_label_table.end(),
+                    [&keys](int a, int b) { return keys.at(a) > keys.at(b); });
+    }
+
+    void orderLabelTableByDataCostBenefit()
     {
-        srand(time(0));
-        random_shuffle(m_label_table.begin(), m_label_table.end());
+        if (! m_data_cost_fn)
+            return shuffleLabelTable();
+
+        vector<VertexDescriptor> vertices;
+        m_sites_store.queryAllVertices(vertices);
+
+        map<int, EnergyType> benefits;
+        for (auto label : m_label_table)
+        {
+            EnergyType benefit = 0;
+            for (auto vertex_desc : vertices)
+            {
+                auto vertex_idx = whichVertexIndex(vertex_desc);
+                auto cost = safeInvokeCostFn(m_data_cost_fn, make_tuple(vertex_idx, label), 0);
+                benefit += max<EnergyType>(0, m_sites_store.dataCost(vertex_desc) - cost);
+            }
+
+            benefits[label] = benefit;
+        }
+
+        sortLabelTableDescending(benefits);
+    }
+
+    void orderLabelTableByPopulation()
+    {
+        map<int, int> populations;
+        for (auto label : m_label_table)
+            populations[label] = 0;
+
+        for (auto label : whichLabels()) {
+            if (populations.count(label))
+                populations[label]++;
+        }
+
+        sortLabelTableDescending(populations);
+    }
+
+    void orderLabelTableRoundRobin()
+    {
+        if (m_label_table.empty())
+            return;
+
+        sort(m_label_table.begin(), m_label_table.end());
+        rotate(m_label_table.begin(),
+               m_label_table.begin() + (m_round_robin_offset++ % m_label_table.size()),
+               m_label_table.end());
+    }
+
+    // Only with a time budget, otherwise the order of setLabelOrdering()
+    // is kept
+    void prioritizeLabelsByGain(size_t first, size_t last)
+    {
+        if (! m_has_deadline)
+            return;
+
+        stable_sort(m_label_table.begin() + first, m_label_table.begin() + last,
+                    [this](int a, int b) { return m_label_gains[a] > m_label_gains[b]; });
+    }
+
+    inline void recordLabelGain(int label, EnergyType energy_before, EnergyType energy_after)
+    {
+        if (energy_before != numeric_limits<EnergyType>::max())
+            m_label_gains[label] = max<EnergyType>(energy_before - energy_after, 0);
+    }
+
+    void ensureWorkerGraphs(size_t n_graphs)
+    {
+        while (m_worker_graphs.size() < n_graphs)
+        {
+            unique_ptr<ExpansionGraph> graph(new ExpansionGraph());
+            initializeExpansionGraph(*graph, m_vertex_descs.size());
+            graph->energy.setMaxFlowAlgorithm(m_max_flow_algorithm);
+
+            m_worker_graphs.push_back(move(graph));
+        }
+    }
+
+    void doParallelExpansionBatch(int iter, size_t first_label)
+    {
+        checkpointIfDue();
+
+        size_t n_proposals = min<size_t>(m_num_threads, m_label_table.size() - first_label);
+        ensureWorkerGraphs(n_proposals);
+
+        // The workers only read the current labeling, each one writes to
+        // its own graph and proposal.
+        vector<ExpansionProposal> proposals(n_proposals);
+        vector<thread> workers;
+
+        for (size_t j = 0; j < n_proposals; j++)
+        {
+            proposals[j].alpha_label = m_label_table[first_label + j];
+            proposals[j].record = ExpansionRecord<EnergyType>(iter, proposals[j].alpha_label);
+            workers.emplace_back([this, j, &proposals]() {
+                auto& graph = *m_worker_graphs[j];
+                auto& proposal = proposals[j];
+                LabelProposal label_proposal(proposal.alpha_label);
+
+                vector<VertexDescriptor> active_sites;
+                collectExpansionSites(label_proposal, active_sites);
+
+                proposal.energy = minimizeExpansionGraph(label_proposal,
+                                                         active_sites,
+                                                         graph,
+                                                         proposal.record);
+                collectSwitchingSites(graph, active_sites, proposal.switching_sites);
+            });
+        }
+
+        for (auto& worker : workers)
+            worker.join();
+
+        for (size_t j = 0; j < n_proposals; j++)
+        {
+            dumpMaxFlowInstance(m_worker_graphs[j]->energy, m_num_expansions + j + 1,
+                                proposals[j].alpha_label);
+            captureMaxFlowInstance(m_worker_graphs[j]->energy, m_num_expansions + j + 1,
+                                   proposals[j].alpha_label);
+        }
+
+        m_num_expansions += n_proposals;
+        commitExpansionProposals(iter, first_label, proposals);
+    }
+
+    void commitExpansionProposals(int iter,
+                                  size_t first_label,
+                                  vector<ExpansionProposal>& proposals)
+    {
+        // A proposal is still exact, as long as none of its switching sites
+        // and their neighbours were relabeled by an earlier proposal of the
+        // batch. Otherwise it is solved again on the current labeling.
+        const EnergyType batch_energy = m_last_expansion_energy;
+        vector<bool> is_relabeled(m_vertex_descs.size(), false);
+        bool has_relabeled = false;
+
+        for (size_t j = 0; j < proposals.size(); j++)
+        {
+            auto& proposal = proposals[j];
+            auto label_iter = first_label + j;
+
+            BOOST_LOG_TRIVIAL(debug) << "\t----------------------------";
+            BOOST_LOG_TRIVIAL(debug) << "\tIter: " << iter;
+            BOOST_LOG_TRIVIAL(debug) << "\tCommitting label: " << proposal.alpha_label;
+
+            if (isProposalAffected(proposal, is_relabeled))
+            {
+                // Only the move that is solved again is recorded, the
+                // outdated worker solve is not a move of its own
+                BOOST_LOG_TRIVIAL(debug) << "\tProposal overlaps an earlier one, solving again";
+                m_last_expansion_energy = computeEnergy();
+                alphaExpansion(iter, label_iter, proposal.alpha_label,
+                               proposal.switching_sites);
+            }
+            else if (proposal.energy < batch_energy && proposal.switching_sites.size() > 0)
+            {
+                proposal.record.sites_changed = acceptNewLabeling(LabelProposal(proposal.alpha_label),
+                                                                  proposal.switching_sites);
+                proposal.record.energy_delta = energyDelta(batch_energy, proposal.energy);
+                recordLabelGain(proposal.alpha_label, batch_energy, proposal.energy);
+                m_statistics.record(proposal.record);
+
+                recordEnergyHistory(iter, label_iter, proposal.alpha_label, proposal.energy);
+            }
+            else
+            {
+                m_label_gains[proposal.alpha_label] = 0;
+                m_statistics.record(proposal.record);
+                continue;
+            }
+
+            for (auto vertex_desc : proposal.switching_sites)
+                is_relabeled[whichVertexIndex(vertex_desc)] = true;
+
+            has_relabeled = has_relabeled || proposal.switching_sites.size() > 0;
+        }
+
+        if (has_relabeled)
+        {
+            updateLabelInformation();
+            m_last_expansion_energy = computeEnergy();
+        }
+    }
+
+    bool isProposalAffected(const ExpansionProposal& proposal,
+                            const vector<bool>& is_relabeled)
+    {
+        for (auto vertex_desc : proposal.switching_sites)
+        {
+            if (is_relabeled[whichVertexIndex(vertex_desc)])
+                return true;
+
+            for (auto nb_vert_desc : m_energy_graph.neighboursOf(vertex_desc))
+            {
+                if (is_relabeled[whichVertexIndex(nb_vert_desc)])
+                    return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * Collects the sites, whose label differs from the proposed one, in the
+     * order of the sites. All other sites keep their label whatever the
+     * cut, so they get no variable.
+     */
+    void collectExpansionSites(const LabelProposal& proposal,
+                               vector<VertexDescriptor>& active_sites)
+    {
+        active_sites.clear();
+
+        for (size_t i = 0; i < m_vertex_descs.size(); i++)
+        {
+            if (m_sites_store.whichLabel(m_vertex_descs[i]) != proposal.labelOf(i))
+                active_sites.push_back(m_vertex_descs[i]);
+        }
+    }
+
+    // Like collectExpansionSites() for an expansion move, but only the sites
+    // within the localized windows
+    void collectWindowSites(int alpha_label,
+                            vector<VertexDescriptor>& active_sites)
+    {
+        active_sites.clear();
+
+        for (auto& window : m_local_windows)
+        {
+            for (int i = window.first; i <= window.last; i++)
+            {
+                if (m_sites_store.whichLabel(m_vertex_descs[i]) != alpha_label)
+                    active_sites.push_back(m_vertex_descs[i]);
+            }
+        }
+    }
+
+    // ChainEnergy only holds the variables of the current move. An
+    // EnergyGraph keeps the vertex of each site, whose edges are reused by
+    // the later moves.
+    static bool hasCompactVariables(const ChainEnergy<EnergyType>&) { return true; }
+    static bool hasCompactVariables(const EnergyGraph<EnergyType>&) { return false; }
+
+    // With compact variables, the i-th active site gets the i-th variable,
+    // so neighbouring active sites of the chain are neighbouring variables
+    // again. Otherwise each site keeps its own vertex.
+    void mapSitesToVariables(const vector<VertexDescriptor>& active_sites,
+                             ExpansionGraph& graph)
+    {
+        bool is_compact = hasCompactVariables(graph.energy);
+        for (auto vertex_idx : graph.variable_sites)
+            graph.is_variable[vertex_idx] = 0;
+        graph.variable_sites.clear();
+
+        for (size_t i = 0; i < active_sites.size(); i++)
+        {
+            auto vertex_idx = whichVertexIndex(active_sites[i]);
+            graph.vertices[vertex_idx] = graph.variables[is_compact ? i : vertex_idx];
+            graph.is_variable[vertex_idx] = 1;
+            graph.variable_sites.push_back(vertex_idx);
+        }
+    }
+
+    EnergyType minimizeExpansionGraph(const LabelProposal& proposal,
+                                      const vector<VertexDescriptor>& active_sites,
+                                      ExpansionGraph& graph,
+                                      ExpansionRecord<EnergyType>& record)
+    {
+        auto build_start = StatisticsPolicy::now();
+
+        // Create binary variables for each active site, add data costs
+        // and compute the smooth costs between variables. The terms of the
+        // fixed sites only add a constant, which is derived from the energy
+        // of the labeling in time linear in the move once that is known.
+        graph.energy.recycle(active_sites.size());
+        graph.is_truncated = false;
+        mapSitesToVariables(active_sites, graph);
+        addDataCostEdges(proposal, active_sites, graph);
+        addSmoothingCostEdges(proposal, active_sites, graph);
+        addLabelCostEdges(proposal, active_sites, graph);
+        if (m_last_expansion_energy == numeric_limits<EnergyType>::max())
+            graph.energy.addConstant(computeFixedSitesEnergy(graph));
+        else
+            graph.energy.addConstant(m_last_expansion_energy
+                                     - computeVariableSitesEnergy(active_sites, graph));
+
+        typedef typename StatisticsPolicy::MaxFlowCountersType MaxFlowCountersType;
+        MaxFlowCountersType counters = MaxFlowCountersType();
+
+        auto flow_start = StatisticsPolicy::now();
+        auto min_energy = graph.energy.minimize(counters);
+        auto flow_end = StatisticsPolicy::now();
+
+        record.build_seconds = StatisticsPolicy::secondsBetween(build_start, flow_start);
+        record.maxflow_seconds = StatisticsPolicy::secondsBetween(flow_start, flow_end);
+        StatisticsPolicy::recordMaxFlowCounters(record, counters);
+
+        return min_energy;
+    }
+
+    inline EnergyType energyDelta(EnergyType energy_before, EnergyType energy_after)
+    {
+        if (energy_before == numeric_limits<EnergyType>::max())
+            return 0;
+
+        return energy_after - energy_before;
     }
 
     bool alphaExpansion(int iter, int label_iter, int alpha_label)
     {
+        vector<VertexDescriptor> switching_sites;
+        return alphaExpansion(iter, label_iter, alpha_label, switching_sites);
+    }
+
+    bool alphaExpansion(int iter, int label_iter, int alpha_label,
+                        vector<VertexDescriptor>& switching_sites)
+    {
+        checkpointIfDue();
+        switching_sites.clear();
+
+        ExpansionRecord<EnergyType> record(iter, alpha_label);
+
+        // Every site takes part in an expansion, either as variable or as
+        // fixed neighbour, so any relabeling may let a failed label succeed
+        if (m_failed_at_version[alpha_label] == m_labeling_version)
+        {
+            BOOST_LOG_TRIVIAL(debug) << "\tLabeling unchanged since last failure, skipping alpha expansion";
+            m_num_unchanged_skips++;
+            m_label_gains[alpha_label] = 0;
+            record.outcome = ExpansionRecord<EnergyType>::SKIPPED_UNCHANGED;
+            m_statistics.record(record);
+            return false;
+        }
+
         // Get list of active sites based on the alpha_label
         vector<VertexDescriptor> active_sites;
-        m_sites_store.queryAllVertices(active_sites);
+        if (m_local_windows.empty())
+            collectExpansionSites(LabelProposal(alpha_label), active_sites);
+        else
+            collectWindowSites(alpha_label, active_sites);
         if (active_sites.size() == 0)
         {
             BOOST_LOG_TRIVIAL(debug) << "\tNo actives vertices, skipping alpha expansion";
             return false;
         }
 
-        // Create binary variables for each remaining site, add data costs
-        // and compute the smooth costs between variables
-        m_energy_graph.recycle();
-        addDataCostEdges(alpha_label, active_sites, m_energy_graph);
-        addSmoothingCostEdges(alpha_label, active_sites, m_energy_graph);
-        addLabelCostEdges(alpha_label, active_sites, m_energy_graph);
+        // The bound compares against the energy of the current labeling,
+        // which is unknown before the first expansion
+        auto bound_start = StatisticsPolicy::now();
+        if (m_last_expansion_energy != numeric_limits<EnergyType>::max()
+            && ! canExpansionImprove(LabelProposal(alpha_label), active_sites))
+        {
+            BOOST_LOG_TRIVIAL(debug) << "\tGain bound excludes an improvement, skipping alpha expansion";
+            m_num_bound_skips++;
+            m_failed_at_version[alpha_label] = m_labeling_version;
+            m_label_gains[alpha_label] = 0;
+            record.outcome = ExpansionRecord<EnergyType>::SKIPPED_BY_BOUND;
+            record.build_seconds = StatisticsPolicy::secondsBetween(bound_start, StatisticsPolicy::now());
+            m_statistics.record(record);
+            return false;
+        }
 
-        EnergyType energy_after_expansion = m_energy_graph.minimize();
+        m_num_expansions++;
+        EnergyType energy_after_expansion = minimizeExpansionGraph(LabelProposal(alpha_label),
+                                                                   active_sites,
+                                                                   m_expansion_graph,
+                                                                   record);
         BOOST_ASSERT(energy_after_expansion >= 0);
 
         BOOST_LOG_TRIVIAL(debug) << "Energy after expansion: " << energy_after_expansion
                                  << ",\tprev expansion Energy: " << m_last_expansion_energy;
 
         dumpEnergyGraph(iter, label_iter, alpha_label, energy_after_expansion);
+        dumpMaxFlowInstance(m_expansion_graph.energy, m_num_expansions, alpha_label);
+        captureMaxFlowInstance(m_expansion_graph.energy, m_num_expansions, alpha_label);
         recordEnergyHistory(iter, label_iter, alpha_label, energy_after_expansion);
 
         bool is_energy_improved = energy_after_expansion < m_last_expansion_energy;
         if (is_energy_improved)
         {
-            acceptNewLabeling(m_energy_graph, alpha_label, active_sites);
-            updateLabelInformation();
+            collectSwitchingSites(m_expansion_graph, active_sites, switching_sites);
+            record.sites_changed = acceptNewLabeling(LabelProposal(alpha_label), switching_sites);
+
+            // acceptNewLabeling() already stored the new data costs. The
+            // minimum of a truncated graph overestimates the energy.
+            if (m_expansion_graph.is_truncated)
+                energy_after_expansion = computeEnergy();
+
+            record.energy_delta = energyDelta(m_last_expansion_energy, energy_after_expansion);
+            recordLabelGain(alpha_label, m_last_expansion_energy, energy_after_expansion);
             m_last_expansion_energy = energy_after_expansion;
         }
+        else
+        {
+            m_failed_at_version[alpha_label] = m_labeling_version;
+            m_label_gains[alpha_label] = 0;
+        }
 
+        m_statistics.record(record);
         return is_energy_improved;
     }
 
-    void addDataCostEdges(const int alpha_label,
+    /**
+     * Upper bound check of the energy decrease of a move in one pass over
+     * the active sites. A site can at most gain its data cost decrease and
+     * the decrease of each of its pairs, when it switches. Any set of
+     * switching sites gains at most the sum of their bounds, so the move
+     * can not improve, if no site has a positive one. Stops at the first
+     * site with a positive bound.
+     */
+    bool canExpansionImprove(const LabelProposal& proposal,
+                             const vector<VertexDescriptor>& active_sites)
+    {
+        for (auto vert_desc : active_sites)
+        {
+            auto vert_idx = whichVertexIndex(vert_desc);
+
+            EnergyType gain = 0;
+            if (m_data_cost_fn) {
+                auto args = make_tuple(vert_idx, proposal.labelOf(vert_idx));
+                gain += m_sites_store.dataCost(vert_desc)
+                      - safeInvokeCostFn(m_data_cost_fn, args, 0);
+            }
+
+            if (m_smooth_cost_fn || m_label_cost_fn)
+            {
+                for (auto nb_vert_desc : m_energy_graph.neighboursOf(vert_desc))
+                {
+                    if (m_smooth_cost_fn)
+                        gain += pairGainBound(m_smooth_cost_fn, proposal, vert_desc, nb_vert_desc);
+                    if (m_label_cost_fn)
+                        gain += pairGainBound(m_label_cost_fn, proposal, vert_desc, nb_vert_desc);
+                }
+            }
+
+            if (gain > 0)
+                return true;
+        }
+
+        return false;
+    }
+
+    // Largest decrease of both orientations of a pair, if the site switches
+    // and its neighbour keeps or, unless it is fixed, switches as well. The
+    // neighbour switching alone is covered by the neighbour's bound.
+    template<typename FnType>
+    inline EnergyType pairGainBound(const FnType& cost_fn,
+                                    const LabelProposal& proposal,
+                                    VertexDescriptor vert_desc,
+                                    VertexDescriptor nb_vert_desc)
+    {
+        auto cur_label = m_sites_store.whichLabel(vert_desc);
+        auto nb_label = m_sites_store.whichLabel(nb_vert_desc);
+
+        auto vert_idx = whichVertexIndex(vert_desc);
+        auto nb_idx = whichVertexIndex(nb_vert_desc);
+
+        auto alpha_label = proposal.labelOf(vert_idx);
+        auto nb_alpha_label = proposal.labelOf(nb_idx);
+
+        auto pair_cost = [&](int label_u, int label_v) {
+            return safeInvokeCostFn(cost_fn, make_tuple(vert_idx, nb_idx, label_u, label_v), 0)
+                 + safeInvokeCostFn(cost_fn, make_tuple(nb_idx, vert_idx, label_v, label_u), 0);
+        };
+
+        auto e00 = pair_cost(cur_label, nb_label);
+        EnergyType gain = e00 - pair_cost(alpha_label, nb_label);
+
+        // If both switch, the decrease is shared with the neighbour's bound
+        if (nb_label != nb_alpha_label) {
+            EnergyType both_gain = e00 - pair_cost(alpha_label, nb_alpha_label);
+            gain = max<EnergyType>(gain, both_gain - both_gain / 2);
+        }
+
+        return max<EnergyType>(0, gain);
+    }
+
+    void addDataCostEdges(const LabelProposal& proposal,
                           const vector<VertexDescriptor>& active_vertices,
-                          EnergyGraph<EnergyType>& energy)
+                          ExpansionGraph& graph)
     {
         if (! m_data_cost_fn)
             return;
@@ -445,29 +1545,29 @@ private:
 
             // TODO: Add correct handling of function arg here
             auto e0 = m_sites_store.dataCost(vertex_desc);
-            auto args = make_tuple(vertex_idx, alpha_label);
+            auto args = make_tuple(vertex_idx, proposal.labelOf(vertex_idx));
             auto e1 = safeInvokeCostFn(m_data_cost_fn, args, 0);
 
-            energy.addTerm1(vertex_desc, e0, e1);
+            graph.energy.addTerm1(graph.vertices[vertex_idx], e0, e1);
         }
     }
 
-    void addSmoothingCostEdges(const int alpha_label,
+    void addSmoothingCostEdges(const LabelProposal& proposal,
                                const vector<VertexDescriptor>& active_vertices,
-                               EnergyGraph<EnergyType>& energy)
+                               ExpansionGraph& graph)
     {
         if (! m_smooth_cost_fn)
             return;
 
         addSmoothingTypeCostEdges(m_smooth_cost_fn,
-                                  alpha_label,
+                                  proposal,
                                   active_vertices,
-                                  energy);
+                                  graph);
     }
 
-    void addLabelCostEdges(const int alpha_label,
+    void addLabelCostEdges(const LabelProposal& proposal,
                            const vector<VertexDescriptor>& active_vertices,
-                           EnergyGraph<EnergyType>& energy)
+                           ExpansionGraph& graph)
     {
         using namespace std;
 
@@ -475,47 +1575,49 @@ private:
             return;
 
         addSmoothingTypeCostEdges(m_label_cost_fn,
-                                  alpha_label,
+                                  proposal,
                                   active_vertices,
-                                  energy);
+                                  graph);
     }
 
-    inline bool isActiveNeighbour(const vector<VertexDescriptor>& actives,
+    inline bool isActiveNeighbour(const ExpansionGraph& graph,
                                   VertexDescriptor neighb)
     {
-        return find(actives.begin(), actives.end(), neighb) != actives.end();
+        return graph.is_variable[whichVertexIndex(neighb)];
     }
 
 
     template<typename FnType>
     void addSmoothingTypeCostEdges(FnType cost_fn,
-                                   const int alpha_label,
+                                   const LabelProposal& proposal,
                                    const vector<VertexDescriptor>& active_vertices,
-                                   EnergyGraph<EnergyType>& energy)
+                                   ExpansionGraph& graph)
     {
         if (! cost_fn)
             return;
 
+        // The neighbourhood is taken from the site graph, the terms are
+        // added to the (possibly private) expansion graph
         for (auto vert_desc : active_vertices)
         {
-            auto neighbouring_vertices = energy.neighboursOf(vert_desc);
+            auto neighbouring_vertices = m_energy_graph.neighboursOf(vert_desc);
             for (auto nb_vert_desc : neighbouring_vertices)
             {
-                if (isActiveNeighbour(active_vertices, nb_vert_desc))
+                if (isActiveNeighbour(graph, nb_vert_desc))
                 {
                     addSmoothingTypeCostsForActiveNeighbourEdge(cost_fn,
-                                                                alpha_label,
+                                                                proposal,
                                                                 vert_desc,
                                                                 nb_vert_desc,
-                                                                energy);
+                                                                graph);
                 }
                 else
                 {
                     addSmoothingTypeCostsForInactiveNeighbourEdge(cost_fn,
-                                                                  alpha_label,
+                                                                  proposal,
                                                                   vert_desc,
                                                                   nb_vert_desc,
-                                                                  energy);
+                                                                  graph);
                 }
             }
         }
@@ -523,10 +1625,10 @@ private:
 
     template<typename FnType>
     inline void addSmoothingTypeCostsForActiveNeighbourEdge(const FnType cost_fn,
-                                                            const int alpha_label,
+                                                            const LabelProposal& proposal,
                                                             const VertexDescriptor& vert_desc,
                                                             const VertexDescriptor& nb_vert_desc,
-                                                            EnergyGraph<EnergyType>& energy)
+                                                            ExpansionGraph& graph)
     {
         auto cur_label = m_sites_store.whichLabel(vert_desc);
         auto nb_label = m_sites_store.whichLabel(nb_vert_desc);
@@ -534,52 +1636,62 @@ private:
         auto vert_idx = whichVertexIndex(vert_desc);
         auto nb_idx = whichVertexIndex(nb_vert_desc);
 
+        auto alpha_label = proposal.labelOf(vert_idx);
+        auto nb_alpha_label = proposal.labelOf(nb_idx);
+
+        // Binary variable 0 (source side) keeps the current label, 1
+        // switches to alpha, the same convention as for the data costs.
         // TODO: Add correct handling of function arg here
-        auto args = make_tuple(vert_idx, nb_idx, alpha_label, alpha_label);
+        auto args = make_tuple(vert_idx, nb_idx, cur_label, nb_label);
         auto e00 = safeInvokeCostFn(cost_fn, args, 0);
 
-        args = make_tuple(vert_idx, nb_idx, alpha_label, nb_label);
+        args = make_tuple(vert_idx, nb_idx, cur_label, nb_alpha_label);
         auto e01 = safeInvokeCostFn(cost_fn, args, 0);
 
-        args = make_tuple(vert_idx, nb_idx, cur_label, alpha_label);
+        args = make_tuple(vert_idx, nb_idx, alpha_label, nb_label);
         auto e10 = safeInvokeCostFn(cost_fn, args, 0);
 
-        args = make_tuple(vert_idx, nb_idx, cur_label, nb_label);
+        args = make_tuple(vert_idx, nb_idx, alpha_label, nb_alpha_label);
         auto e11 = safeInvokeCostFn(cost_fn, args, 0);
 
-        if (e00 + e11 > e01 + e10)
+        if (e00 + e11 > e01 + e10 && isSubmodularityRequired(graph.energy))
         {
-            //BOOST_LOG_TRIVIAL(warning) << "Non submoduler smoothness term detected";
-            //return;
-            healSubmodularEnergies(e00, e01, e10, e11);
+            truncateToSubmodular(e00, e01, e10, e11);
+            graph.is_truncated = true;
         }
 
-        energy.addTerm2(vert_desc, nb_vert_desc, e00, e01, e10, e11);
+        graph.energy.addTerm2(graph.vertices[vert_idx], graph.vertices[nb_idx],
+                              e00, e01, e10, e11);
     }
 
-    inline void healSubmodularEnergies(EnergyType& e00,
-                                       EnergyType& e01,
-                                       EnergyType& e10,
-                                       EnergyType& e11)
+    // The dynamic program of ChainEnergy minimizes any pairwise term, the
+    // max-flow solvers of EnergyGraph only submodular ones
+    static bool isSubmodularityRequired(const ChainEnergy<EnergyType>&) { return false; }
+    static bool isSubmodularityRequired(const EnergyGraph<EnergyType>&) { return true; }
+
+    /**
+     * Makes a pair submodular by adding the violation to the costs of the
+     * states, in which one site switches. The current labeling keeps its
+     * cost and no state gets cheaper, so the move still never increases
+     * the energy, but the minimum it reports is only an upper bound.
+     */
+    inline void truncateToSubmodular(EnergyType e00,
+                                     EnergyType& e01,
+                                     EnergyType& e10,
+                                     EnergyType e11)
     {
+        EnergyType violation = e00 + e11 - e01 - e10;
 
-        for (int i = 0; e00 + e11 > e01 + e10; i++)
-        {
-            if (i % 3 == 0)
-                e01++;
-            else if (i % 3 == 1)
-                e10++;
-            else
-                e00--;
-        }
+        e01 += violation - violation / 2;
+        e10 += violation / 2;
     }
 
     template<typename FnType>
     inline void addSmoothingTypeCostsForInactiveNeighbourEdge(const FnType cost_fn,
-                                                              const int alpha_label,
+                                                              const LabelProposal& proposal,
                                                               const VertexDescriptor& vert_desc,
                                                               const VertexDescriptor& nb_vert_desc,
-                                                              EnergyGraph<EnergyType>& energy)
+                                                              ExpansionGraph& graph)
     {
         auto cur_label = m_sites_store.whichLabel(vert_desc);
         auto nb_label = m_sites_store.whichLabel(nb_vert_desc);
@@ -587,38 +1699,160 @@ private:
         auto vert_idx = whichVertexIndex(vert_desc);
         auto nb_idx = whichVertexIndex(nb_vert_desc);
 
-        auto args = make_tuple(vert_idx, nb_idx, alpha_label, nb_label);
-        auto e0 = safeInvokeCostFn(cost_fn, args, 0);
+        auto alpha_label = proposal.labelOf(vert_idx);
 
-        args = make_tuple(vert_idx, nb_idx, cur_label, nb_label);
-        auto e1 = safeInvokeCostFn(cost_fn, args, 0);
+        // The neighbour keeps its label, so both orientations of the pair
+        // are folded into a unary term, as computeEnergy() counts both
+        auto args = make_tuple(vert_idx, nb_idx, cur_label, nb_label);
+        auto rev_args = make_tuple(nb_idx, vert_idx, nb_label, cur_label);
+        auto e0 = safeInvokeCostFn(cost_fn, args, 0)
+                + safeInvokeCostFn(cost_fn, rev_args, 0);
 
-        energy.addTerm1(vert_desc, e0, e1);
+        args = make_tuple(vert_idx, nb_idx, alpha_label, nb_label);
+        rev_args = make_tuple(nb_idx, vert_idx, nb_label, alpha_label);
+        auto e1 = safeInvokeCostFn(cost_fn, args, 0)
+                + safeInvokeCostFn(cost_fn, rev_args, 0);
+
+        graph.energy.addTerm1(graph.vertices[vert_idx], e0, e1);
     }
 
-    void acceptNewLabeling(EnergyGraph<EnergyType>& energy,
-                           const int alpha_label,
-                           const vector<VertexDescriptor>& active_sites)
+    /**
+     * Energy of the terms without a variable: the data costs of the fixed
+     * sites and the pairwise costs among them, counted like in
+     * computeEnergy(). Added as constant, the move reports the energy of
+     * the whole labeling. Takes time linear in all sites, so it is only
+     * used until the energy of the labeling is known.
+     */
+    EnergyType computeFixedSitesEnergy(const ExpansionGraph& graph)
     {
-        if (active_sites.size() == 0)
-            return;
+        EnergyType energy = 0;
 
-        BOOST_LOG_TRIVIAL(debug) << "Energy decreased, so assigning new labeling";
-        for (VertexDescriptor vertex_desc : active_sites)
+        for (size_t i = 0; i < m_vertex_descs.size(); i++)
         {
-            if (energy(vertex_desc).color == boost::black_color)
+            if (graph.is_variable[i])
                 continue;
 
-            auto data_cost = 0;
-            if (m_data_cost_fn) {
-                auto vertex_idx = whichVertexIndex(vertex_desc);
+            auto vert_desc = m_vertex_descs[i];
+            if (m_data_cost_fn)
+                energy += m_sites_store.dataCost(vert_desc);
+
+            if (! m_smooth_cost_fn && ! m_label_cost_fn)
+                continue;
+
+            auto cur_label = m_sites_store.whichLabel(vert_desc);
+            for (auto nb_vert_desc : m_energy_graph.neighboursOf(vert_desc))
+            {
+                auto nb_idx = whichVertexIndex(nb_vert_desc);
+                if (graph.is_variable[nb_idx])
+                    continue;
+
+                auto args = make_tuple((int)i, nb_idx, cur_label,
+                                       m_sites_store.whichLabel(nb_vert_desc));
+                if (m_smooth_cost_fn)
+                    energy += safeInvokeCostFn(m_smooth_cost_fn, args, 0);
+                if (m_label_cost_fn)
+                    energy += safeInvokeCostFn(m_label_cost_fn, args, 0);
+            }
+        }
+
+        return energy;
+    }
+
+    /**
+     * Energy of the terms with a variable, if all variables keep their label:
+     * the data costs of the active sites and their pairwise costs, counted
+     * like in computeEnergy(). Subtracted from the energy of the labeling, it
+     * yields the energy of the fixed sites in time linear in the move.
+     */
+    EnergyType computeVariableSitesEnergy(const vector<VertexDescriptor>& active_sites,
+                                          const ExpansionGraph& graph)
+    {
+        EnergyType energy = 0;
+
+        for (auto vert_desc : active_sites)
+        {
+            if (m_data_cost_fn)
+                energy += m_sites_store.dataCost(vert_desc);
+
+            if (! m_smooth_cost_fn && ! m_label_cost_fn)
+                continue;
+
+            auto vert_idx = whichVertexIndex(vert_desc);
+            auto cur_label = m_sites_store.whichLabel(vert_desc);
+            for (auto nb_vert_desc : m_energy_graph.neighboursOf(vert_desc))
+            {
+                auto nb_idx = whichVertexIndex(nb_vert_desc);
+                auto nb_label = m_sites_store.whichLabel(nb_vert_desc);
+
+                // A pair of two variables is visited from both sites
+                auto args = make_tuple(vert_idx, nb_idx, cur_label, nb_label);
+                auto rev_args = make_tuple(nb_idx, vert_idx, nb_label, cur_label);
+                bool is_fixed_nb = ! graph.is_variable[nb_idx];
+
+                if (m_smooth_cost_fn) {
+                    energy += safeInvokeCostFn(m_smooth_cost_fn, args, 0);
+                    if (is_fixed_nb)
+                        energy += safeInvokeCostFn(m_smooth_cost_fn, rev_args, 0);
+                }
+                if (m_label_cost_fn) {
+                    energy += safeInvokeCostFn(m_label_cost_fn, args, 0);
+                    if (is_fixed_nb)
+                        energy += safeInvokeCostFn(m_label_cost_fn, rev_args, 0);
+                }
+            }
+        }
+
+        return energy;
+    }
+
+    void collectSwitchingSites(ExpansionGraph& graph,
+                               const vector<VertexDescriptor>& active_sites,
+                               vector<VertexDescriptor>& switching_sites)
+    {
+        switching_sites.clear();
+
+        for (auto vertex_desc : active_sites)
+        {
+            auto vertex_idx = whichVertexIndex(vertex_desc);
+            if (graph.energy(graph.vertices[vertex_idx]).color == boost::black_color)
+                continue;
+
+            switching_sites.push_back(vertex_desc);
+        }
+    }
+
+    size_t acceptNewLabeling(const LabelProposal& proposal,
+                             const vector<VertexDescriptor>& switching_sites)
+    {
+        if (switching_sites.size() == 0)
+            return 0;
+
+        BOOST_LOG_TRIVIAL(debug) << "Energy decreased, so assigning new labeling";
+
+        size_t n_changed = 0;
+        for (VertexDescriptor vertex_desc : switching_sites)
+        {
+            auto vertex_idx = whichVertexIndex(vertex_desc);
+            auto alpha_label = proposal.labelOf(vertex_idx);
+            if (m_sites_store.whichLabel(vertex_desc) != alpha_label) {
+                n_changed++;
+                if (m_local_window_radius > 0)
+                    m_relabeled_sites.push_back(vertex_idx);
+            }
 
+            EnergyType data_cost = 0;
+            if (m_data_cost_fn) {
                 auto args = make_tuple(vertex_idx, alpha_label);
                 data_cost = safeInvokeCostFn(m_data_cost_fn, args, 0);
             }
 
             m_sites_store.assignLabel(vertex_desc, alpha_label, data_cost);
         }
+
+        if (n_changed > 0)
+            m_labeling_version++;
+
+        return n_changed;
     }
 
     EnergyType computeEnergy()
@@ -707,7 +1941,7 @@ private:
         return cost;
     }
 
-    void dumpEnergyGraph(int iter, int label_iter, int alpha_label, int energy, bool display = false)
+    void dumpEnergyGraph(int iter, int label_iter, int alpha_label, EnergyType energy, bool display = false)
     {
         if (! m_record_energy_graph_dumps)
             return;
@@ -717,7 +1951,7 @@ private:
                << setw(3) << setfill('0') << label_iter << "_"
                << "label_" << setw(5) << setfill('0') << alpha_label << "_"
                << "energy_" << setw(5) << setfill('0') << energy << ".gv";
-        m_energy_graph.dumpAsGraphviz(gvName.str());
+        m_expansion_graph.energy.dumpAsGraphviz(gvName.str());
 
         if (display)
         {
@@ -726,9 +1960,33 @@ private:
         }
     }
 
-    void recordEnergyHistory(int iter, int label_iter, int alpha_label, int energy, bool display = false)
+    void dumpMaxFlowInstance(ExpansionEnergyType& energy, int expansion, int alpha_label)
+    {
+        if (m_max_flow_dump_prefix.empty())
+            return;
+
+        stringstream dimacsName;
+        dimacsName << m_max_flow_dump_prefix
+                   << setw(6) << setfill('0') << expansion << "_"
+                   << "label_" << setw(5) << setfill('0') << alpha_label << ".max";
+        energy.dumpAsDimacs(dimacsName.str());
+    }
+
+    void captureMaxFlowInstance(ExpansionEnergyType& energy, int expansion, int alpha_label)
+    {
+        if (! m_max_flow_capture.isOpen())
+            return;
+
+        energy.captureInstance(m_captured_instance);
+        m_captured_instance.expansion = expansion;
+        m_captured_instance.alpha_label = alpha_label;
+        m_max_flow_capture.write(m_captured_instance);
+    }
+
+    void recordEnergyHistory(int iter, int label_iter, int alpha_label, EnergyType energy, bool display = false)
     {
-        if (! m_record_energy_history)
+        // Not within localized sweeps, as it costs a pass over all sites
+        if (! m_record_energy_history || ! m_local_windows.empty())
             return;
 
         computeEnergy();
@@ -10,12 +10,10 @@
 #include <boost/config.hpp>
 #include <boost/assert.hpp>
 #include <vector>
-#include <list>
 #include <utility>
 #include <iosfwd>
 #include <algorithm> // for std::min and std::max
 
-#include <boost/pending/queue.hpp>
 #include <boost/limits.hpp>
 #include <boost/property_map/property_map.hpp>
 #include <boost/none_t.hpp>
@@ -24,11 +22,122 @@
 #include <boost/graph/lookup_edge.hpp>
 #include <boost/concept/assert.hpp>
 
+#include "maxflow_counters.h"
+
 namespace detail
 {
 
 using namespace boost;
 
+/**
+ * FIFO/LIFO queue on a preallocated array. Each vertex is in a queue of the
+ * solver at most once, so the number of vertices is a sufficient capacity.
+ * reset() only allocates if the capacity grows.
+ */
+template <class Value>
+class bk_ring_buffer
+{
+public:
+    bk_ring_buffer():
+        m_head(0),
+        m_size(0)
+    { }
+
+    void reset(std::size_t capacity)
+    {
+        if(m_data.size() < capacity)
+            m_data.resize(capacity);
+        m_head = 0;
+        m_size = 0;
+    }
+
+    inline bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    inline std::size_t size() const
+    {
+        return m_size;
+    }
+
+    inline const Value& front() const
+    {
+        BOOST_ASSERT(m_size > 0);
+        return m_data[m_head];
+    }
+
+    inline void push_back(const Value& v)
+    {
+        BOOST_ASSERT(m_size < m_data.size());
+        std::size_t tail = m_head + m_size;
+        if(tail >= m_data.size())
+            tail -= m_data.size();
+        m_data[tail] = v;
+        ++m_size;
+    }
+
+    inline void push_front(const Value& v)
+    {
+        BOOST_ASSERT(m_size < m_data.size());
+        m_head = (m_head == 0 ? m_data.size() : m_head) - 1;
+        m_data[m_head] = v;
+        ++m_size;
+    }
+
+    inline void pop_front()
+    {
+        BOOST_ASSERT(m_size > 0);
+        if(++m_head == m_data.size())
+            m_head = 0;
+        --m_size;
+    }
+
+private:
+    std::vector<Value> m_data;
+    std::size_t m_head;
+    std::size_t m_size;
+};
+
+} //namespace detail
+
+/**
+ * Per-vertex state and queues of bk_max_flow. Keeping a workspace alive
+ * between max-flow calls on graphs of the same size avoids any heap
+ * allocation in the solver after the first call.
+ */
+template <class Graph>
+struct bk_max_flow_workspace
+{
+    typedef typename boost::graph_traits<Graph>::vertex_descriptor vertex_descriptor;
+    typedef typename boost::graph_traits<Graph>::edge_descriptor edge_descriptor;
+    typedef typename boost::graph_traits<Graph>::vertices_size_type vertices_size_type;
+
+    void reset(std::size_t n_verts)
+    {
+        in_active_list.assign(n_verts, false);
+        has_parent.assign(n_verts, false);
+        time.assign(n_verts, 0);
+        predecessors.resize(n_verts);
+        distances.resize(n_verts);
+        active_nodes.reset(n_verts);
+        orphans.reset(n_verts);
+        child_orphans.reset(n_verts);
+    }
+
+    std::vector<bool> in_active_list;
+    std::vector<bool> has_parent;
+    std::vector<long> time;
+    std::vector<edge_descriptor> predecessors;
+    std::vector<vertices_size_type> distances;
+    detail::bk_ring_buffer<vertex_descriptor> active_nodes;
+    detail::bk_ring_buffer<vertex_descriptor> orphans;      //LIFO, nearest to the terminals first
+    detail::bk_ring_buffer<vertex_descriptor> child_orphans; //FIFO
+};
+
+namespace detail
+{
+
 template <class Graph,
          class EdgeCapacityMap,
          class ResidualCapacityEdgeMap,
@@ -36,7 +145,8 @@ template <class Graph,
          class PredecessorMap,
          class ColorMap,
          class DistanceMap,
-         class IndexMap>
+         class IndexMap,
+         class Counters = NoMaxFlowCounters>
 class bk_max_flow
 {
     typedef typename property_traits<EdgeCapacityMap>::value_type tEdgeVal;
@@ -46,7 +156,7 @@ class bk_max_flow
     typedef typename tGraphTraits::edge_descriptor edge_descriptor;
     typedef typename tGraphTraits::edge_iterator edge_iterator;
     typedef typename tGraphTraits::out_edge_iterator out_edge_iterator;
-    typedef boost::queue<vertex_descriptor> tQueue;                               //queue of vertices, used in adoption-stage
+    typedef bk_ring_buffer<vertex_descriptor> tQueue;                             //queue of vertices, used in adoption-stage
     typedef typename property_traits<ColorMap>::value_type tColorValue;
     typedef color_traits<tColorValue> tColorTraits;
     typedef typename property_traits<DistanceMap>::value_type tDistanceVal;
@@ -61,7 +171,9 @@ public:
                 DistanceMap dist,
                 IndexMap idx,
                 vertex_descriptor src,
-                vertex_descriptor sink):
+                vertex_descriptor sink,
+                bk_max_flow_workspace<Graph>& workspace,
+                Counters& counters):
         m_g(g),
         m_index_map(idx),
         m_cap_map(cap),
@@ -72,16 +184,19 @@ public:
         m_dist_map(dist),
         m_source(src),
         m_sink(sink),
-        m_active_nodes(),
-        m_in_active_list_vec(num_vertices(g), false),
+        m_active_nodes((workspace.reset(num_vertices(g)), workspace.active_nodes)),
+        m_in_active_list_vec(workspace.in_active_list),
         m_in_active_list_map(make_iterator_property_map(m_in_active_list_vec.begin(), m_index_map)),
-        m_has_parent_vec(num_vertices(g), false),
+        m_orphans(workspace.orphans),
+        m_child_orphans(workspace.child_orphans),
+        m_has_parent_vec(workspace.has_parent),
         m_has_parent_map(make_iterator_property_map(m_has_parent_vec.begin(), m_index_map)),
-        m_time_vec(num_vertices(g), 0),
+        m_time_vec(workspace.time),
         m_time_map(make_iterator_property_map(m_time_vec.begin(), m_index_map)),
         m_flow(0),
         m_time(1),
-        m_last_grow_vertex(graph_traits<Graph>::null_vertex())
+        m_last_grow_vertex(graph_traits<Graph>::null_vertex()),
+        m_counters(counters)
     {
         // initialize the color-map with gray-values
         vertex_iterator vi, v_end;
@@ -146,6 +261,7 @@ protected:
                 tEdgeVal cap = get(m_res_cap_map, from_source);
                 put(m_res_cap_map, from_source, 0);
                 m_flow += cap;
+                m_counters.countAugmentation(1);
                 continue;
             }
             edge_descriptor to_sink;
@@ -168,6 +284,7 @@ protected:
                     put(m_res_cap_map, from_source, get(m_res_cap_map, from_source) - cap_to_sink);
                     put(m_res_cap_map, to_sink, 0);
                     m_flow += cap_to_sink;
+                    m_counters.countAugmentation(2);
                 }
                 else if(cap_to_sink > 0)
                 {
@@ -182,6 +299,7 @@ protected:
                     put(m_res_cap_map, to_sink, get(m_res_cap_map, to_sink) - cap_from_source);
                     put(m_res_cap_map, from_source, 0);
                     m_flow += cap_from_source;
+                    m_counters.countAugmentation(2);
                 }
             }
             else if(get(m_res_cap_map, from_source))
@@ -240,6 +358,7 @@ protected:
                 for(; m_last_grow_edge_it != m_last_grow_edge_end; ++m_last_grow_edge_it)
                 {
                     edge_descriptor out_edge = *m_last_grow_edge_it;
+                    m_counters.countEdgeScan();
                     if(get(m_res_cap_map, out_edge) > 0)  //check if we have capacity left on this edge
                     {
                         vertex_descriptor other_node = target(out_edge, m_g);
@@ -284,6 +403,7 @@ protected:
                 for(; m_last_grow_edge_it != m_last_grow_edge_end; ++m_last_grow_edge_it)
                 {
                     edge_descriptor in_edge = get(m_rev_edge_map, *m_last_grow_edge_it);
+                    m_counters.countEdgeScan();
                     if(get(m_res_cap_map, in_edge) > 0)  //check if there is capacity left
                     {
                         vertex_descriptor other_node = source(in_edge, m_g);
@@ -343,6 +463,7 @@ protected:
         BOOST_ASSERT(m_orphans.empty());
 
         const tEdgeVal bottleneck = find_bottleneck(e);
+        std::size_t path_length = 1;
         //now we push the found flow through the path
         //for each edge we saturate we have to look for the verts that belong to that edge, one of them becomes an orphans
         //now process the connecting edge
@@ -364,6 +485,7 @@ protected:
                 m_orphans.push_front(current_node);
             }
             current_node = source(pred, m_g);
+            ++path_length;
         }
         //then go forward in the sink-tree
         current_node = target(e, m_g);
@@ -379,9 +501,11 @@ protected:
                 m_orphans.push_front(current_node);
             }
             current_node = target(pred, m_g);
+            ++path_length;
         }
         //and add it to the max-flow
         m_flow += bottleneck;
+        m_counters.countAugmentation(path_length);
     }
 
     /**
@@ -430,8 +554,9 @@ protected:
             else
             {
                 current_node = m_child_orphans.front();
-                m_child_orphans.pop();
+                m_child_orphans.pop_front();
             }
+            m_counters.countOrphan();
             if(get_tree(current_node) == tColorTraits::black())
             {
                 //we're in the source-tree
@@ -479,7 +604,7 @@ protected:
                                 //we are the parent of that node
                                 //it has to find a new parent, too
                                 set_no_parent(other_node);
-                                m_child_orphans.push(other_node);
+                                m_child_orphans.push_back(other_node);
                             }
                         }
                     }
@@ -530,7 +655,7 @@ protected:
                             {
                                 //we were it's parent, so it has to find a new one, too
                                 set_no_parent(other_node);
-                                m_child_orphans.push(other_node);
+                                m_child_orphans.push_back(other_node);
                             }
                         }
                     }
@@ -554,7 +679,7 @@ protected:
             //if it has no parent, this node can't be active (if its not source or sink)
             if(!has_parent(v) && v != m_source && v != m_sink)
             {
-                m_active_nodes.pop();
+                m_active_nodes.pop_front();
                 put(m_in_active_list_map, v, false);
             }
             else
@@ -582,7 +707,8 @@ protected:
         else
         {
             put(m_in_active_list_map, v, true);
-            m_active_nodes.push(v);
+            m_active_nodes.push_back(v);
+            m_counters.observeActiveNodes(m_active_nodes.size());
         }
     }
 
@@ -592,7 +718,7 @@ protected:
     inline void finish_node(vertex_descriptor v)
     {
         BOOST_ASSERT(m_active_nodes.front() == v);
-        m_active_nodes.pop();
+        m_active_nodes.pop_front();
         put(m_in_active_list_map, v, false);
         m_last_grow_vertex = graph_traits<Graph>::null_vertex();
     }
@@ -776,30 +902,33 @@ protected:
     vertex_descriptor m_source;
     vertex_descriptor m_sink;
 
-    tQueue m_active_nodes;
-    std::vector<bool> m_in_active_list_vec;
+    tQueue& m_active_nodes;
+    std::vector<bool>& m_in_active_list_vec;
     iterator_property_map<std::vector<bool>::iterator, IndexMap> m_in_active_list_map;
 
-    std::list<vertex_descriptor> m_orphans;
-    tQueue m_child_orphans; // we use a second queuqe for child orphans, as they are FIFO processed
+    tQueue& m_orphans; // used as a stack, see augment()
+    tQueue& m_child_orphans; // we use a second queuqe for child orphans, as they are FIFO processed
 
-    std::vector<bool> m_has_parent_vec;
+    std::vector<bool>& m_has_parent_vec;
     iterator_property_map<std::vector<bool>::iterator, IndexMap> m_has_parent_map;
 
-    std::vector<long> m_time_vec; //timestamp of each node, used for sink/source-path calculations
+    std::vector<long>& m_time_vec; //timestamp of each node, used for sink/source-path calculations
     iterator_property_map<std::vector<long>::iterator, IndexMap> m_time_map;
     tEdgeVal m_flow;
     long m_time;
     vertex_descriptor m_last_grow_vertex;
     out_edge_iterator m_last_grow_edge_it;
     out_edge_iterator m_last_grow_edge_end;
+    Counters& m_counters;
 };
 
 } //namespace detail
 
 /**
   * non-named-parameter version, given everything
-  * this is the catch all version
+  * this is the catch all version. The per-vertex state and queues are taken
+  * from workspace, the solver reports its work to counters, see
+  * maxflow_counters.h.
   */
 template<class Graph,
          class CapacityEdgeMap,
@@ -807,7 +936,8 @@ template<class Graph,
          class ReverseEdgeMap, class PredecessorMap,
          class ColorMap,
          class DistanceMap,
-         class IndexMap>
+         class IndexMap,
+         class Counters>
 typename boost::property_traits<CapacityEdgeMap>::value_type
 bk_max_flow(Graph& g,
             CapacityEdgeMap cap,
@@ -818,7 +948,9 @@ bk_max_flow(Graph& g,
             DistanceMap dist,
             IndexMap idx,
             typename boost::graph_traits<Graph>::vertex_descriptor src,
-            typename boost::graph_traits<Graph>::vertex_descriptor sink)
+            typename boost::graph_traits<Graph>::vertex_descriptor sink,
+            bk_max_flow_workspace<Graph>& workspace,
+            Counters& counters)
 {
     typedef typename boost::graph_traits<Graph>::vertex_descriptor vertex_descriptor;
     typedef typename boost::graph_traits<Graph>::edge_descriptor edge_descriptor;
@@ -838,23 +970,25 @@ bk_max_flow(Graph& g,
 
     detail::bk_max_flow<
     Graph, CapacityEdgeMap, ResidualCapacityEdgeMap, ReverseEdgeMap,
-           PredecessorMap, ColorMap, DistanceMap, IndexMap
-           > algo(g, cap, res_cap, rev_map, pre_map, color, dist, idx, src, sink);
+           PredecessorMap, ColorMap, DistanceMap, IndexMap, Counters
+           > algo(g, cap, res_cap, rev_map, pre_map, color, dist, idx, src, sink, workspace, counters);
 
     return algo.max_flow();
 }
 
 /**
  * non-named-parameter version, some given: capacity, residual_capacity,
- * reverse_edges, color_map and an index map. Use this if you are interested in
- * the minimum cut, as the color map provides that info.
+ * reverse_edges, color_map and an index map. Predecessors, distances and
+ * the queues are kept in workspace, which can be reused for the next call.
+ * The work of the solver is reported to counters.
  */
 template<class Graph,
          class CapacityEdgeMap,
          class ResidualCapacityEdgeMap,
          class ReverseEdgeMap,
          class ColorMap,
-         class IndexMap>
+         class IndexMap,
+         class Counters>
 typename boost::property_traits<CapacityEdgeMap>::value_type
 bk_max_flow(Graph& g,
             CapacityEdgeMap cap,
@@ -863,18 +997,45 @@ bk_max_flow(Graph& g,
             ColorMap color,
             IndexMap idx,
             typename boost::graph_traits<Graph>::vertex_descriptor src,
-            typename boost::graph_traits<Graph>::vertex_descriptor sink)
+            typename boost::graph_traits<Graph>::vertex_descriptor sink,
+            bk_max_flow_workspace<Graph>& workspace,
+            Counters& counters)
 {
-    typename boost::graph_traits<Graph>::vertices_size_type n_verts = num_vertices(g);
-    std::vector<typename boost::graph_traits<Graph>::edge_descriptor> predecessor_vec(n_verts);
-    std::vector<typename boost::graph_traits<Graph>::vertices_size_type> distance_vec(n_verts);
+    // size the workspace before the property maps refer to its vectors
+    workspace.reset(num_vertices(g));
     return
         bk_max_flow(
             g, cap, res_cap, rev,
-            make_iterator_property_map(predecessor_vec.begin(), idx),
+            make_iterator_property_map(workspace.predecessors.begin(), idx),
             color,
-            make_iterator_property_map(distance_vec.begin(), idx),
-            idx, src, sink);
+            make_iterator_property_map(workspace.distances.begin(), idx),
+            idx, src, sink, workspace, counters);
+}
+
+/**
+ * non-named-parameter version, some given: capacity, residual_capacity,
+ * reverse_edges, color_map and an index map. Use this if you are interested in
+ * the minimum cut, as the color map provides that info.
+ */
+template<class Graph,
+         class CapacityEdgeMap,
+         class ResidualCapacityEdgeMap,
+         class ReverseEdgeMap,
+         class ColorMap,
+         class IndexMap>
+typename boost::property_traits<CapacityEdgeMap>::value_type
+bk_max_flow(Graph& g,
+            CapacityEdgeMap cap,
+            ResidualCapacityEdgeMap res_cap,
+            ReverseEdgeMap rev,
+            ColorMap color,
+            IndexMap idx,
+            typename boost::graph_traits<Graph>::vertex_descriptor src,
+            typename boost::graph_traits<Graph>::vertex_descriptor sink)
+{
+    bk_max_flow_workspace<Graph> workspace;
+    NoMaxFlowCounters counters;
+    return bk_max_flow(g, cap, res_cap, rev, color, idx, src, sink, workspace, counters);
 }
 
 #endif // BK_MAX_FLOW_H
@@ -0,0 +1,389 @@
+#ifndef CHAIN_ENERGY_H
+#define CHAIN_ENERGY_H
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/assert.hpp>
+#include <boost/graph/properties.hpp>
+
+#include "energy.h"
+#include "maxflow_capture.h"
+#include "maxflow_counters.h"
+
+/**
+ * Binary energy, whose pairwise terms only connect the variables i and
+ * i+1, like the expansion graph of a one dimensional signal. It has the
+ * interface of EnergyGraph used by the alpha expansion, but the neighbours
+ * are implicit and only capacities are stored: the source and sink
+ * capacity of each variable and the capacities of each link from i to i+1
+ * and back. The terms are decomposed into capacities exactly like in
+ * EnergyGraph, so both report the same minimum.
+ *
+ * The minimum cut of a chain is found by dynamic programming in a forward
+ * pass and traced back in a backward pass, which puts a variable on the
+ * source side (black) only where no minimum cut with the same remaining
+ * chain puts it on the sink side. For submodular terms, this is the
+ * smallest source side among the minimum cuts, the one the max-flow
+ * solvers of EnergyGraph yield.
+ *
+ * The dynamic program does not need non-negative capacities, so unlike
+ * EnergyGraph, pairwise terms need not be submodular. Their link keeps the
+ * negative capacity and the minimum is still exact.
+ */
+template<typename EnergyType = long long>
+class ChainEnergy
+{
+public:
+    typedef int VertexDescriptor;
+    typedef typename EnergyGraph<EnergyType>::MaxFlowAlgorithm MaxFlowAlgorithm;
+
+    struct VertexProperties
+    {
+        VertexProperties()
+            : color(boost::white_color)
+        { }
+
+        boost::default_color_type color;
+    };
+
+public:
+    ChainEnergy()
+        : m_energy_const(0)
+    { }
+
+    ~ChainEnergy()
+    { }
+
+    /**
+     * The chain is always solved by dynamic programming, the max-flow
+     * algorithm of EnergyGraph has no effect.
+     */
+    void setMaxFlowAlgorithm(MaxFlowAlgorithm)
+    { }
+
+    inline VertexProperties& operator()(VertexDescriptor vert_desc)
+    {
+        return m_vertices[vert_desc];
+    }
+
+    EnergyType addConstant(EnergyType energy_to_add)
+    {
+        m_energy_const += energy_to_add;
+        return m_energy_const;
+    }
+
+    VertexDescriptor addVariable()
+    {
+        if (! m_vertices.empty()) {
+            m_forward_cap.push_back(0);
+            m_backward_cap.push_back(0);
+        }
+
+        m_vertices.push_back(VertexProperties());
+        m_source_cap.push_back(0);
+        m_sink_cap.push_back(0);
+
+        return m_vertices.size() - 1;
+    }
+
+    void addTerm1(VertexDescriptor vert_desc, EnergyType A, EnergyType B)
+    {
+        addTerminalCapacity(vert_desc, B, A);
+    }
+
+    void addTerm2(VertexDescriptor vert_u, VertexDescriptor vert_v,
+                  EnergyType A, EnergyType B, EnergyType C, EnergyType D)
+    {
+        // Same decomposition as EnergyGraph::addTerm2
+        addTerminalCapacity(vert_u, D, A);
+
+        B = B - A;
+        C = C - D;
+
+        if (B + C < 0)
+        {
+            // Not submodular, the link keeps its negative capacity
+            addLinkCapacity(vert_u, vert_v, B, C);
+        }
+        else if (B < 0)
+        {
+            addTerminalCapacity(vert_u, 0,  B);
+            addTerminalCapacity(vert_v, 0, -B);
+            addEdge(vert_u, vert_v, 0, B+C);
+        }
+        else if (C < 0)
+        {
+            addTerminalCapacity(vert_u, 0, -C);
+            addTerminalCapacity(vert_v, 0,  C);
+            addEdge(vert_u, vert_v, B+C, 0);
+        }
+        else
+        {
+            addEdge(vert_u, vert_v, B, C);
+        }
+    }
+
+    EnergyType minimize()
+    {
+        NoMaxFlowCounters counters;
+        return minimize(counters);
+    }
+
+    /**
+     * Minimizes the energy, each link visited in a pass is reported to
+     * counters as an edge scan.
+     */
+    template<typename Counters>
+    EnergyType minimize(Counters& counters)
+    {
+        const std::size_t n = m_vertices.size();
+        if (n == 0)
+            return m_energy_const;
+
+        m_forward0.resize(n);
+        m_forward1.resize(n);
+
+        // x = 0 is the source side, which cuts the sink capacity
+        m_forward0[0] = m_sink_cap[0];
+        m_forward1[0] = m_source_cap[0];
+        for (std::size_t i = 0; i + 1 < n; i++)
+        {
+            counters.countEdgeScan();
+            m_forward0[i+1] = m_sink_cap[i+1]
+                            + std::min(m_forward0[i], m_forward1[i] + m_backward_cap[i]);
+            m_forward1[i+1] = m_source_cap[i+1]
+                            + std::min(m_forward0[i] + m_forward_cap[i], m_forward1[i]);
+        }
+
+        // Trace one minimum back from the last variable, preferring the
+        // sink side on ties. Every prefix then has the most sink side
+        // variables that still complete to a minimum.
+        const EnergyType min_cut = std::min(m_forward0[n-1], m_forward1[n-1]);
+        bool is_sink_side = m_forward1[n-1] <= m_forward0[n-1];
+        m_vertices[n-1].color = is_sink_side ? boost::white_color : boost::black_color;
+        for (std::size_t i = n - 1; i > 0; i--)
+        {
+            counters.countEdgeScan();
+            EnergyType source_side = m_forward0[i-1] + (is_sink_side ? m_forward_cap[i-1] : 0);
+            EnergyType sink_side = m_forward1[i-1] + (is_sink_side ? 0 : m_backward_cap[i-1]);
+            is_sink_side = sink_side <= source_side;
+            m_vertices[i-1].color = is_sink_side ? boost::white_color : boost::black_color;
+        }
+
+        return min_cut + m_energy_const;
+    }
+
+    void recycle()
+    {
+        recycle(m_vertices.size());
+    }
+
+    /**
+     * Resets the energy to a chain of the first n_variables variables, the
+     * others are dropped. The memory is kept for later moves.
+     */
+    void recycle(std::size_t n_variables)
+    {
+        m_vertices.resize(n_variables);
+        m_source_cap.resize(n_variables);
+        m_sink_cap.resize(n_variables);
+        m_forward_cap.resize(n_variables > 0 ? n_variables - 1 : 0);
+        m_backward_cap.resize(n_variables > 0 ? n_variables - 1 : 0);
+
+        std::fill(m_source_cap.begin(), m_source_cap.end(), 0);
+        std::fill(m_sink_cap.begin(), m_sink_cap.end(), 0);
+        std::fill(m_forward_cap.begin(), m_forward_cap.end(), 0);
+        std::fill(m_backward_cap.begin(), m_backward_cap.end(), 0);
+
+        for (auto& vertex : m_vertices)
+            vertex.color = boost::white_color;
+
+        m_energy_const = 0;
+    }
+
+    /**
+     * Writes the capacities in the DIMACS max-flow format with the vertex
+     * numbering of EnergyGraph::dumpAsDimacs: source 1, sink 2 and
+     * variable i as i + 3.
+     */
+    void dumpAsDimacs(const std::string file_name)
+    {
+        std::ofstream ostream(file_name);
+        dumpAsDimacs(ostream);
+        ostream.close();
+    }
+
+    void dumpAsDimacs(std::ostream& ostream)
+    {
+        std::size_t n_arcs = 0;
+        for (std::size_t i = 0; i < m_vertices.size(); i++)
+            n_arcs += (m_source_cap[i] > 0) + (m_sink_cap[i] > 0);
+
+        // Links of non-submodular terms have no max-flow equivalent
+        std::size_t n_negative_links = 0;
+        for (std::size_t i = 0; i < m_forward_cap.size(); i++) {
+            n_arcs += (m_forward_cap[i] > 0) + (m_backward_cap[i] > 0);
+            n_negative_links += (m_forward_cap[i] < 0 || m_backward_cap[i] < 0);
+        }
+
+        if (n_negative_links > 0)
+            ostream << "c omitted negative capacities of " << n_negative_links << " links\n";
+
+        ostream << "c energy constant " << m_energy_const << "\n"
+                << "p max " << m_vertices.size() + 2 << " " << n_arcs << "\n"
+                << "n 1 s\n"
+                << "n 2 t\n";
+
+        for (std::size_t i = 0; i < m_vertices.size(); i++)
+        {
+            if (m_source_cap[i] > 0)
+                ostream << "a 1 " << i + 3 << " " << m_source_cap[i] << "\n";
+            if (m_sink_cap[i] > 0)
+                ostream << "a " << i + 3 << " 2 " << m_sink_cap[i] << "\n";
+        }
+
+        for (std::size_t i = 0; i < m_forward_cap.size(); i++)
+        {
+            if (m_forward_cap[i] > 0)
+                ostream << "a " << i + 3 << " " << i + 4 << " " << m_forward_cap[i] << "\n";
+            if (m_backward_cap[i] > 0)
+                ostream << "a " << i + 4 << " " << i + 3 << " " << m_backward_cap[i] << "\n";
+        }
+    }
+
+    /**
+     * Stores the capacities in instance for a capture file. Links without
+     * capacities are omitted, negative links of non-submodular terms are
+     * kept.
+     */
+    void captureInstance(MaxFlowInstance& instance)
+    {
+        instance.energy_const = m_energy_const;
+        instance.source_caps.assign(m_source_cap.begin(), m_source_cap.end());
+        instance.sink_caps.assign(m_sink_cap.begin(), m_sink_cap.end());
+        instance.links.clear();
+
+        for (std::size_t i = 0; i < m_forward_cap.size(); i++)
+        {
+            if (m_forward_cap[i] == 0 && m_backward_cap[i] == 0)
+                continue;
+
+            MaxFlowInstance::Link link;
+            link.u = i;
+            link.v = i + 1;
+            link.cap = m_forward_cap[i];
+            link.rev_cap = m_backward_cap[i];
+            instance.links.push_back(link);
+        }
+    }
+
+    void dumpAsGraphviz(const std::string file_name)
+    {
+        std::ofstream ostream(file_name);
+        dumpAsGraphviz(ostream);
+        ostream.close();
+    }
+
+    void dumpAsGraphviz(std::ostream& ostream)
+    {
+        ostream << "digraph G {\n"
+                << "s;\n"
+                << "t;\n";
+
+        for (std::size_t i = 0; i < m_vertices.size(); i++)
+        {
+            ostream << i << " [label=\"" << i << "\"";
+            if (m_vertices[i].color == boost::black_color)
+                ostream << ", color=black, fontcolor=white, style=filled";
+            ostream << "];\n";
+
+            if (m_source_cap[i] > 0)
+                ostream << "s->" << i << " [ label=\"c:" << m_source_cap[i] << "\"];\n";
+            if (m_sink_cap[i] > 0)
+                ostream << i << "->t [ label=\"c:" << m_sink_cap[i] << "\"];\n";
+        }
+
+        for (std::size_t i = 0; i < m_forward_cap.size(); i++)
+        {
+            if (m_forward_cap[i] > 0)
+                ostream << i << "->" << i + 1 << " [ label=\"c:" << m_forward_cap[i] << "\"];\n";
+            if (m_backward_cap[i] > 0)
+                ostream << i + 1 << "->" << i << " [ label=\"c:" << m_backward_cap[i] << "\"];\n";
+        }
+
+        ostream << "}\n";
+    }
+
+private:
+    // Same normalization of negative capacities as in EnergyGraph
+    inline void addTerminalCapacity(VertexDescriptor vert_desc,
+                                    EnergyType source_cap,
+                                    EnergyType target_cap)
+    {
+        if (source_cap < 0) {
+            target_cap -= source_cap;
+            m_energy_const += source_cap;
+            source_cap = 0;
+        }
+
+        if (target_cap < 0) {
+            source_cap -= target_cap;
+            m_energy_const += target_cap;
+            target_cap = 0;
+        }
+
+        m_source_cap[vert_desc] += source_cap;
+        m_sink_cap[vert_desc] += target_cap;
+    }
+
+    void addEdge(VertexDescriptor vert_u, VertexDescriptor vert_v,
+                 EnergyType cap, EnergyType rev_cap)
+    {
+        if (cap < 0) {
+            rev_cap -= cap;
+            cap = 0;
+        }
+
+        if (rev_cap < 0) {
+            cap -= rev_cap;
+            rev_cap = 0;
+        }
+
+        addLinkCapacity(vert_u, vert_v, cap, rev_cap);
+    }
+
+    void addLinkCapacity(VertexDescriptor vert_u, VertexDescriptor vert_v,
+                         EnergyType cap, EnergyType rev_cap)
+    {
+        BOOST_ASSERT(std::abs(vert_u - vert_v) == 1);
+
+        if (vert_u < vert_v) {
+            m_forward_cap[vert_u] += cap;
+            m_backward_cap[vert_u] += rev_cap;
+        }
+        else {
+            m_forward_cap[vert_v] += rev_cap;
+            m_backward_cap[vert_v] += cap;
+        }
+    }
+
+    std::vector<VertexProperties> m_vertices;
+
+    std::vector<EnergyType> m_source_cap;
+    std::vector<EnergyType> m_sink_cap;
+    std::vector<EnergyType> m_forward_cap;  // link i: i -> i+1
+    std::vector<EnergyType> m_backward_cap; // link i: i+1 -> i
+
+    // lowest energy of the variables before and including i, with i on
+    // the source (0) or sink (1) side
+    std::vector<EnergyType> m_forward0;
+    std::vector<EnergyType> m_forward1;
+
+    EnergyType m_energy_const;
+};
+
+#endif // CHAIN_ENERGY_H
@@ -0,0 +1,281 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/log/trivial.hpp>
+
+/**
+ * State of BinaryOptimization, from which an interrupted run continues:
+ * the labeling, the order of the label table, the counters and the
+ * energy history. The random engine is stored in its text form, so a
+ * resumed run proposes the labels in the same order.
+ */
+struct OptimizationState
+{
+    OptimizationState()
+        : num_expansions(0)
+        , num_bound_skips(0)
+        , num_unchanged_skips(0)
+        , round_robin_offset(0)
+    { }
+
+    std::vector<std::int32_t> labels;
+    std::vector<std::int32_t> label_table;
+    std::int64_t num_expansions;
+    std::int64_t num_bound_skips;
+    std::int64_t num_unchanged_skips;
+    std::int64_t round_robin_offset;
+    std::string random_state;
+    std::map<std::string, std::vector<std::int64_t>> energy_history;
+};
+
+/**
+ * Whether each label of label_table lies in [0, n_labels) and occurs only
+ * once. The label table of a checkpoint written during a coarse-to-fine
+ * pass holds only a subset of the labels.
+ */
+inline bool hasDistinctLabels(const std::vector<std::int32_t>& label_table, std::size_t n_labels)
+{
+    std::vector<bool> is_seen(n_labels, false);
+    for (auto label : label_table) {
+        if (label < 0 || static_cast<std::size_t>(label) >= n_labels || is_seen[label])
+            return false;
+        is_seen[label] = true;
+    }
+
+    return true;
+}
+
+/**
+ * Checkpoint of a graph_processing run. Besides the optimizer state, it
+ * keeps the run length encoded input (the value and length of each
+ * plateau) and the levels, so a resumed run needs neither input file.
+ */
+struct Checkpoint
+{
+    Checkpoint()
+        : num_samples(0)
+    { }
+
+    std::uint64_t num_samples;
+    std::vector<double> data;
+    std::vector<double> weights;
+    std::vector<double> levels;
+    OptimizationState state;
+};
+
+namespace checkpoint_io
+{
+    static const char tag[8] = "EBSCKP1";
+
+    template<typename T>
+    inline void writeValue(std::ostream& ostream, T value)
+    {
+        ostream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    inline void writeVector(std::ostream& ostream, const std::vector<T>& values)
+    {
+        writeValue<std::uint64_t>(ostream, values.size());
+        if (! values.empty())
+            ostream.write(reinterpret_cast<const char*>(&values[0]), values.size() * sizeof(T));
+    }
+
+    inline void writeString(std::ostream& ostream, const std::string& value)
+    {
+        writeValue<std::uint64_t>(ostream, value.size());
+        ostream.write(value.data(), value.size());
+    }
+
+    template<typename T>
+    inline bool readValue(std::istream& istream, T& value)
+    {
+        return static_cast<bool>(istream.read(reinterpret_cast<char*>(&value), sizeof(T)));
+    }
+
+    template<typename T>
+    inline bool readVector(std::istream& istream, std::vector<T>& values)
+    {
+        std::uint64_t size = 0;
+        if (! readValue(istream, size))
+            return false;
+
+        // grow in chunks while reading, so a corrupt size fails at the end
+        // of the file instead of allocating it up front
+        const std::uint64_t chunk_size = 1 << 20;
+        values.clear();
+        while (values.size() < size) {
+            std::size_t offset = values.size();
+            std::size_t n_values = std::min(chunk_size, size - offset);
+            values.resize(offset + n_values);
+            if (! istream.read(reinterpret_cast<char*>(&values[offset]), n_values * sizeof(T)))
+                return false;
+        }
+
+        return true;
+    }
+
+    inline bool readString(std::istream& istream, std::string& value)
+    {
+        std::vector<char> chars;
+        if (! readVector(istream, chars))
+            return false;
+
+        value.assign(chars.begin(), chars.end());
+        return true;
+    }
+}
+
+/**
+ * Writes the checkpoint in a binary format: the tag "EBSCKP1", the
+ * plateaus and levels, then the optimizer state. Numbers are in the byte
+ * order of the machine. The file is written next to file_name first and
+ * renamed, so an interrupted write keeps the previous checkpoint.
+ */
+inline bool saveCheckpoint(const std::string& file_name, const Checkpoint& checkpoint)
+{
+    using namespace checkpoint_io;
+
+    std::string tmp_file_name = file_name + ".tmp";
+    {
+        std::ofstream ostream(tmp_file_name, std::ios::binary | std::ios::trunc);
+        ostream.write(tag, sizeof(tag));
+
+        writeValue(ostream, checkpoint.num_samples);
+        writeVector(ostream, checkpoint.data);
+        writeVector(ostream, checkpoint.weights);
+        writeVector(ostream, checkpoint.levels);
+
+        auto& state = checkpoint.state;
+        writeVector(ostream, state.labels);
+        writeVector(ostream, state.label_table);
+        writeValue(ostream, state.num_expansions);
+        writeValue(ostream, state.num_bound_skips);
+        writeValue(ostream, state.num_unchanged_skips);
+        writeValue(ostream, state.round_robin_offset);
+        writeString(ostream, state.random_state);
+
+        writeValue<std::uint64_t>(ostream, state.energy_history.size());
+        for (auto& history : state.energy_history) {
+            writeString(ostream, history.first);
+            writeVector(ostream, history.second);
+        }
+
+        if (! ostream.good())
+            return false;
+    }
+
+    return std::rename(tmp_file_name.c_str(), file_name.c_str()) == 0;
+}
+
+/**
+ * Reads a checkpoint written by saveCheckpoint(). Returns false, if the
+ * file cannot be read or is no checkpoint.
+ */
+inline bool loadCheckpoint(const std::string& file_name, Checkpoint& checkpoint)
+{
+    using namespace checkpoint_io;
+
+    std::ifstream istream(file_name, std::ios::binary);
+
+    char file_tag[sizeof(tag)];
+    if (! istream.read(file_tag, sizeof(file_tag)) || std::memcmp(file_tag, tag, sizeof(tag)) != 0)
+        return false;
+
+    auto& state = checkpoint.state;
+    if (! readValue(istream, checkpoint.num_samples)
+        || ! readVector(istream, checkpoint.data)
+        || ! readVector(istream, checkpoint.weights)
+        || ! readVector(istream, checkpoint.levels)
+        || ! readVector(istream, state.labels)
+        || ! readVector(istream, state.label_table)
+        || ! readValue(istream, state.num_expansions)
+        || ! readValue(istream, state.num_bound_skips)
+        || ! readValue(istream, state.num_unchanged_skips)
+        || ! readValue(istream, state.round_robin_offset)
+        || ! readString(istream, state.random_state))
+        return false;
+
+    std::uint64_t n_histories = 0;
+    if (! readValue(istream, n_histories))
+        return false;
+
+    state.energy_history.clear();
+    for (std::uint64_t i = 0; i < n_histories; i++) {
+        std::string label;
+        if (! readString(istream, label) || ! readVector(istream, state.energy_history[label]))
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Saves checkpoints on a background thread, so the optimizer only pays
+ * for copying its state. While a checkpoint is still being written, new
+ * ones are dropped, the next one follows after the next interval.
+ */
+class CheckpointWriter
+{
+public:
+    explicit CheckpointWriter(const std::string& file_name)
+        : m_file_name(file_name)
+        , m_is_writing(false)
+    { }
+
+    ~CheckpointWriter()
+    {
+        wait();
+    }
+
+    /**
+     * Starts writing checkpoint. Returns false, if the previous one is
+     * still being written.
+     */
+    bool writeAsync(Checkpoint&& checkpoint)
+    {
+        if (m_is_writing)
+            return false;
+
+        wait();
+        m_is_writing = true;
+
+        std::string file_name = m_file_name;
+        std::atomic<bool>& is_writing = m_is_writing;
+        m_thread = std::thread([file_name, &is_writing](const Checkpoint& checkpoint) {
+            if (! saveCheckpoint(file_name, checkpoint))
+                BOOST_LOG_TRIVIAL(error) << "Unable to write the checkpoint '" << file_name << "'";
+            else
+                BOOST_LOG_TRIVIAL(debug) << "Wrote checkpoint '" << file_name << "'";
+
+            is_writing = false;
+        }, std::move(checkpoint));
+
+        return true;
+    }
+
+    void wait()
+    {
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+private:
+    std::string m_file_name;
+    std::thread m_thread;
+    std::atomic<bool> m_is_writing;
+};
+
+#endif // CHECKPOINT_H
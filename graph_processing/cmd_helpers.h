@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <limits>
 
 #include "../common/cmd_helpers.h"
 #include "binopt.h"
@@ -28,6 +29,87 @@ namespace cmd
         */
         out_file.close();
     }
+
+    template <typename RecordType, typename EnergyType>
+    bool saveStatisticsReport(const std::string& filename,
+                              const StageTimes& stage_times,
+                              const std::vector<RecordType>& records,
+                              EnergyType energy,
+                              bool is_completed,
+                              long peak_rss_kb)
+    {
+        using namespace std;
+
+        ofstream out_file(filename, ios::trunc);
+        if (! out_file.is_open()) {
+            BOOST_LOG_TRIVIAL(error) << "Unable to open statistics file '" << filename << "'";
+            return false;
+        }
+
+        // float energies with all their digits, the timings keep the
+        // default precision
+        auto precision = out_file.precision(numeric_limits<EnergyType>::max_digits10);
+        out_file << "{" << endl
+                 << "  \"energy\": " << energy << "," << endl;
+        out_file.precision(precision);
+
+        out_file << "  \"completed\": " << (is_completed ? "true" : "false") << "," << endl
+                 << "  \"peak_rss_kb\": " << peak_rss_kb << "," << endl
+                 << "  \"stages\": {";
+
+        auto &stages = stage_times.stages();
+        for (size_t i = 0; i < stages.size(); i++) {
+            out_file << (i > 0 ? "," : "") << endl
+                     << "    \"" << stages[i].first << "\": " << stages[i].second;
+        }
+
+        // Summed over all moves, to tell graph construction bound runs from
+        // max-flow bound ones
+        double build_seconds = 0.0, maxflow_seconds = 0.0;
+        std::size_t augmentations = 0, orphans = 0;
+        std::size_t outcomes[3] = { 0, 0, 0 };
+        for (auto &r : records) {
+            build_seconds += r.build_seconds;
+            maxflow_seconds += r.maxflow_seconds;
+            augmentations += r.maxflow.augmentations;
+            orphans += r.maxflow.orphans;
+            outcomes[r.outcome]++;
+        }
+
+        const char* outcome_names[] = { "executed", "skipped_by_bound", "skipped_unchanged" };
+
+        out_file << endl << "  }," << endl
+                 << "  \"totals\": {\"build_s\": " << build_seconds
+                 << ", \"maxflow_s\": " << maxflow_seconds
+                 << ", \"augmentations\": " << augmentations
+                 << ", \"orphans\": " << orphans
+                 << ", \"executed\": " << outcomes[RecordType::EXECUTED]
+                 << ", \"skipped_by_bound\": " << outcomes[RecordType::SKIPPED_BY_BOUND]
+                 << ", \"skipped_unchanged\": " << outcomes[RecordType::SKIPPED_UNCHANGED] << "}," << endl
+                 << "  \"expansions\": [";
+
+        for (size_t i = 0; i < records.size(); i++) {
+            auto &r = records[i];
+            out_file << (i > 0 ? "," : "") << endl
+                     << "    {\"iteration\": " << r.iteration
+                     << ", \"label\": " << r.label
+                     << ", \"outcome\": \"" << outcome_names[r.outcome] << "\""
+                     << ", \"build_s\": " << r.build_seconds
+                     << ", \"maxflow_s\": " << r.maxflow_seconds
+                     << ", \"sites_changed\": " << r.sites_changed
+                     << ", \"energy_delta\": " << r.energy_delta
+                     << ", \"edge_scans\": " << r.maxflow.edge_scans
+                     << ", \"augmentations\": " << r.maxflow.augmentations
+                     << ", \"path_length\": " << r.maxflow.path_length
+                     << ", \"orphans\": " << r.maxflow.orphans
+                     << ", \"max_active_nodes\": " << r.maxflow.max_active_nodes << "}";
+        }
+
+        out_file << endl << "  ]" << endl
+                 << "}" << endl;
+
+        return out_file.good();
+    }
 }
 
 #endif // GRAPHCMD_HELPER_H
\ No newline at end of file
@@ -2,6 +2,8 @@
 #define ENERGY_H
 
 #include <functional>
+#include <map>
+#include <string>
 
 #include <boost/iterator.hpp>
 #include <boost/graph/adjacency_list.hpp>
@@ -9,7 +11,10 @@
 #include <boost/graph/iteration_macros.hpp>
 
 #include "helpers.h"
+#include "maxflow_capture.h"
 #include "bk_max_flow.h"
+#include "ibfs_max_flow.h"
+#include "pseudoflow_max_flow.h"
 
 template<typename EnergyType = long long>
 class EnergyGraph
@@ -22,6 +27,8 @@ public:
     typedef typename Traits::vertex_descriptor VertexDescriptor;
     typedef typename Traits::edge_descriptor EdgeDescriptor;
 
+    // Only what the max-flow solvers need. The names of the vertices are
+    // derived from the index, see vertexName()
     struct VertexProperties
     {
         VertexProperties()
@@ -29,9 +36,7 @@ public:
             , color(boost::gray_color)
         { }
 
-        VertexDescriptor desc;
         int index;
-        std::string name;
         boost::default_color_type color;
     };
 
@@ -60,9 +65,7 @@ public:
                                   GraphPropertiesType
                                 > Graph;
 
-    typedef typename boost::property_map<Graph, VertexDescriptor VertexProperties::*>::type DescMapType;
     typedef typename boost::property_map<Graph, int VertexProperties::*>::type IndexMapType;
-    typedef typename boost::property_map<Graph, std::string VertexProperties::*>::type NameMapType;
     typedef typename boost::property_map<Graph, boost::default_color_type VertexProperties::*>::type ColorMapType;
     typedef typename boost::property_map<Graph, EnergyType EdgeProperties::*>::type CapacityMapType;
     typedef typename boost::property_map<Graph, EdgeDescriptor EdgeProperties::*>::type ReverseMapType;
@@ -74,12 +77,25 @@ public:
 
     enum EdgeDirection { IN, OUT };
 
+    /**
+     * Max-flow solvers which can minimize the energy. All of them yield
+     * the same cut: the vertices reachable from the source in the residual
+     * graph are colored black.
+     */
+    enum MaxFlowAlgorithm
+    {
+        BOYKOV_KOLMOGOROV,
+        IBFS,
+        PSEUDOFLOW
+    };
+
 public:
     EnergyGraph()
         : m_current_index(0)
         , m_energy_const(0)
         , m_flow(0)
         , m_check_submodularity(true)
+        , m_max_flow_algorithm(BOYKOV_KOLMOGOROV)
     {
         initializePropertyMaps();
         initializeTerminalVertices();
@@ -88,6 +104,16 @@ public:
     ~EnergyGraph()
     { }
 
+    void setMaxFlowAlgorithm(MaxFlowAlgorithm algorithm)
+    {
+        m_max_flow_algorithm = algorithm;
+    }
+
+    MaxFlowAlgorithm maxFlowAlgorithm() const
+    {
+        return m_max_flow_algorithm;
+    }
+
     inline std::pair<VertexIter, VertexIter> variableIterator()
     {
         return vertices(m_energy_graph);
@@ -124,7 +150,7 @@ public:
         return m_energy_graph[vert_decl];
     }
 
-    long addConstant(EnergyType energy_to_add)
+    EnergyType addConstant(EnergyType energy_to_add)
     {
         m_energy_const += energy_to_add;
         return m_energy_const;
@@ -140,8 +166,8 @@ public:
 
     VertexDescriptor addVariable(std::string name)
     {
-        auto vertex_desc = boost::add_vertex(m_energy_graph);
-        initializeNewlyAddedVariable(vertex_desc, name);
+        auto vertex_desc = addVariable();
+        m_vertex_names[vertex_desc] = name;
 
         return vertex_desc;
     }
@@ -149,11 +175,30 @@ public:
     VertexDescriptor addVariable()
     {
         auto vertex_desc = boost::add_vertex(m_energy_graph);
-        initializeNewlyAddedVariable(vertex_desc, std::to_string(m_current_index - 2));
+        initializeNewlyAddedVariable(vertex_desc);
 
         return vertex_desc;
     }
 
+    /**
+     * Name of a vertex in dumps and lookups: the name it was added with,
+     * "s" and "t" for the terminals and the number of the variable
+     * otherwise.
+     */
+    std::string vertexName(VertexDescriptor vert_desc)
+    {
+        auto it = m_vertex_names.find(vert_desc);
+        if (it != m_vertex_names.end())
+            return it->second;
+
+        if (vert_desc == m_s_vertex)
+            return "s";
+        if (vert_desc == m_t_vertex)
+            return "t";
+
+        return std::to_string(m_energy_graph[vert_desc].index - 2);
+    }
+
     void addTerm1(VertexDescriptor vert_desc, EnergyType A, EnergyType B)
     {
         addTerminalCapacity(vert_desc, B, A);
@@ -171,8 +216,7 @@ public:
          A A
          D D
         */
-        addTerminalCapacity(vert_u, 0, A);
-        addTerminalCapacity(vert_v, D, 0);
+        addTerminalCapacity(vert_u, D, A);
 
         B = B - A;
         C = C - D;
@@ -374,9 +418,55 @@ public:
     }
 
     EnergyType minimize()
+    {
+        NoMaxFlowCounters counters;
+        return minimize(counters);
+    }
+
+    /**
+     * Minimizes the energy with the selected max-flow algorithm and reports
+     * the work of the solver to counters (NoMaxFlowCounters or
+     * MaxFlowCounters). The solver state is
+     * kept between calls, so after the first one no memory is allocated.
+     */
+    template<typename Counters>
+    EnergyType minimize(Counters& counters)
     {
         using namespace boost;
 
+        if (m_max_flow_algorithm == IBFS)
+        {
+            auto max_flow_ibfs = ibfs_max_flow(m_energy_graph,
+                                               m_capacity_prop,
+                                               m_residual_capacity_prop,
+                                               m_reverse_prop,
+                                               m_color_prop,
+                                               m_index_prop,
+                                               m_s_vertex,
+                                               m_t_vertex,
+                                               m_ibfs_workspace,
+                                               counters);
+            colorSourceSide();
+
+            return max_flow_ibfs + m_energy_const;
+        }
+
+        if (m_max_flow_algorithm == PSEUDOFLOW)
+        {
+            auto max_flow_pseudo = pseudoflow_max_flow(m_energy_graph,
+                                                       m_capacity_prop,
+                                                       m_residual_capacity_prop,
+                                                       m_reverse_prop,
+                                                       m_index_prop,
+                                                       m_s_vertex,
+                                                       m_t_vertex,
+                                                       m_pseudoflow_workspace,
+                                                       counters);
+            colorSourceSide();
+
+            return max_flow_pseudo + m_energy_const;
+        }
+
         /*
         typedef std::map<VertexDescriptor, std::size_t> IndexMap;
         IndexMap map_index;
@@ -401,7 +491,9 @@ public:
                                        //get(boost::vertex_index, m_energy_graph),
                                        m_index_prop,
                                        m_s_vertex,
-                                       m_t_vertex);
+                                       m_t_vertex,
+                                       m_max_flow_workspace,
+                                       counters);
 
         return max_flow_bk + m_energy_const;
     }
@@ -421,6 +513,106 @@ public:
 
         for (; ei != ei_end; ei++)
             recycleEdge(*ei);
+
+        m_energy_const = 0;
+    }
+
+    /**
+     * Resets the energy for a move over the first n_variables variables
+     * only. The graph keeps all of its vertices, the remaining ones stay
+     * without capacities and do not take part in the cut.
+     */
+    void recycle(std::size_t n_variables)
+    {
+        BOOST_ASSERT(n_variables + 2 <= boost::num_vertices(m_energy_graph));
+        recycle();
+    }
+
+    /**
+     * Writes the max-flow instance (terminal and pairwise capacities) in
+     * the DIMACS max-flow format. Vertex i of the file has index i - 1,
+     * the source and sink are the vertices 1 and 2.
+     */
+    void dumpAsDimacs(const std::string file_name)
+    {
+        std::ofstream ostream(file_name);
+        dumpAsDimacs(ostream);
+        ostream.close();
+    }
+
+    void dumpAsDimacs(std::ostream& ostream)
+    {
+        using namespace boost;
+
+        EdgeIter ei, ei_end;
+        std::size_t n_arcs = 0;
+        for (boost::tie(ei, ei_end) = edges(m_energy_graph); ei != ei_end; ei++)
+        {
+            if (get(m_capacity_prop, *ei) > 0)
+                n_arcs++;
+        }
+
+        ostream << "c energy constant " << m_energy_const << "\n"
+                << "p max " << num_vertices(m_energy_graph) << " " << n_arcs << "\n"
+                << "n " << get(m_index_prop, m_s_vertex) + 1 << " s\n"
+                << "n " << get(m_index_prop, m_t_vertex) + 1 << " t\n";
+
+        for (boost::tie(ei, ei_end) = edges(m_energy_graph); ei != ei_end; ei++)
+        {
+            auto cap = get(m_capacity_prop, *ei);
+            if (cap <= 0)
+                continue;
+
+            ostream << "a " << get(m_index_prop, source(*ei, m_energy_graph)) + 1
+                    << " " << get(m_index_prop, target(*ei, m_energy_graph)) + 1
+                    << " " << cap << "\n";
+        }
+    }
+
+    /**
+     * Stores the terminal and pairwise capacities in instance for a
+     * capture file. Variable i is the vertex with index i + 2, links
+     * without capacities are omitted.
+     */
+    void captureInstance(MaxFlowInstance& instance)
+    {
+        using namespace boost;
+
+        const std::size_t n_variables = num_vertices(m_energy_graph) - 2;
+        instance.energy_const = m_energy_const;
+        instance.source_caps.assign(n_variables, 0);
+        instance.sink_caps.assign(n_variables, 0);
+        instance.links.clear();
+
+        EdgeIter ei, ei_end;
+        for (boost::tie(ei, ei_end) = edges(m_energy_graph); ei != ei_end; ei++)
+        {
+            auto vert_u = source(*ei, m_energy_graph);
+            auto vert_v = target(*ei, m_energy_graph);
+            auto cap = get(m_capacity_prop, *ei);
+
+            if (vert_u == m_s_vertex && vert_v != m_t_vertex)
+                instance.source_caps[get(m_index_prop, vert_v) - 2] += cap;
+            else if (vert_v == m_t_vertex && vert_u != m_s_vertex)
+                instance.sink_caps[get(m_index_prop, vert_u) - 2] += cap;
+            else if (vert_u != m_t_vertex && vert_v != m_s_vertex
+                     && get(m_index_prop, vert_u) < get(m_index_prop, vert_v))
+            {
+                EdgeDescriptor rev_edge;
+                bool has_rev_edge;
+                boost::tie(rev_edge, has_rev_edge) = edge(vert_v, vert_u, m_energy_graph);
+                auto rev_cap = has_rev_edge ? get(m_capacity_prop, rev_edge) : EnergyType(0);
+
+                if (cap != 0 || rev_cap != 0) {
+                    MaxFlowInstance::Link link;
+                    link.u = get(m_index_prop, vert_u) - 2;
+                    link.v = get(m_index_prop, vert_v) - 2;
+                    link.cap = cap;
+                    link.rev_cap = rev_cap;
+                    instance.links.push_back(link);
+                }
+            }
+        }
     }
 
     void dumpAsGraphviz(const std::string file_name)
@@ -445,8 +637,7 @@ public:
             auto color = get(m_color_prop, u);
 
             os << " ["
-               << "label=\"" << get(m_name_prop, u) << "\"";
-               //<< "[" << get(m_desc_prop, u) << "]\"";
+               << "label=\"" << vertexName(u) << "\"";
             if (color == black_color)
                 os << ", color=black, fontcolor=white, style=filled";
             os << "]";
@@ -479,41 +670,78 @@ private:
     VertexDescriptor m_s_vertex;
     VertexDescriptor m_t_vertex;
 
-    DescMapType m_desc_prop;
     int m_current_index;
     IndexMapType m_index_prop;
-    NameMapType m_name_prop;
     ColorMapType m_color_prop;
     CapacityMapType m_capacity_prop;
     ReverseMapType m_reverse_prop;
     ResidualCapacityType m_residual_capacity_prop;
 
+    // names of the variables added with a name, all others are generated
+    std::map<VertexDescriptor, std::string> m_vertex_names;
+
+    bk_max_flow_workspace<Graph> m_max_flow_workspace;
+    ibfs_max_flow_workspace<Graph> m_ibfs_workspace;
+    pseudoflow_max_flow_workspace<Graph, EnergyType> m_pseudoflow_workspace;
+    std::vector<VertexDescriptor> m_cut_stack;
+
     EnergyType m_energy_const;
     EnergyType m_flow;
 
     bool m_check_submodularity;
+    MaxFlowAlgorithm m_max_flow_algorithm;
 
 private:
+    /**
+     * Colors the vertices reachable from the source in the residual graph
+     * black and all others white. This is the cut bk_max_flow yields, so
+     * all algorithms agree on the labeling.
+     */
+    void colorSourceSide()
+    {
+        using namespace boost;
+
+        VertexIter vi, vi_end;
+        for (boost::tie(vi, vi_end) = vertices(m_energy_graph); vi != vi_end; vi++)
+            put(m_color_prop, *vi, white_color);
+
+        m_cut_stack.clear();
+        m_cut_stack.push_back(m_s_vertex);
+        put(m_color_prop, m_s_vertex, black_color);
+
+        while (! m_cut_stack.empty())
+        {
+            auto vert_desc = m_cut_stack.back();
+            m_cut_stack.pop_back();
+
+            typename graph_traits<Graph>::out_edge_iterator ei, ei_end;
+            for (boost::tie(ei, ei_end) = out_edges(vert_desc, m_energy_graph); ei != ei_end; ei++)
+            {
+                auto other_desc = target(*ei, m_energy_graph);
+                if (get(m_residual_capacity_prop, *ei) > 0 &&
+                    get(m_color_prop, other_desc) != black_color)
+                {
+                    put(m_color_prop, other_desc, black_color);
+                    m_cut_stack.push_back(other_desc);
+                }
+            }
+        }
+    }
+
     void initializeTerminalVertices()
     {
         m_s_vertex = boost::add_vertex(m_energy_graph);
-        put(m_desc_prop, m_s_vertex, m_s_vertex);
         put(m_index_prop, m_s_vertex, m_current_index++);
-        put(m_name_prop, m_s_vertex, "s");
 
         m_t_vertex = boost::add_vertex(m_energy_graph);
-        put(m_desc_prop, m_t_vertex, m_t_vertex);
         put(m_index_prop, m_t_vertex, m_current_index++);
-        put(m_name_prop, m_t_vertex, "t");
     }
 
     void initializePropertyMaps()
     {
         using namespace boost;
 
-        m_desc_prop = get(&VertexProperties::desc, m_energy_graph);
         m_index_prop = get(&VertexProperties::index, m_energy_graph);
-        m_name_prop = get(&VertexProperties::name, m_energy_graph);
         m_color_prop = get(&VertexProperties::color, m_energy_graph);
         m_capacity_prop = get(&EdgeProperties::capacity, m_energy_graph);
         m_residual_capacity_prop = get(&EdgeProperties::residual_capacity, m_energy_graph);
@@ -521,12 +749,9 @@ private:
     }
 
     void initializeNewlyAddedVariable(VertexDescriptor& vert_desc,
-                                      std::string name,
                                       bool connect_to_terminals = true)
     {
-        put(m_desc_prop, vert_desc, vert_desc);
         put(m_index_prop, vert_desc, m_current_index++);
-        put(m_name_prop, vert_desc, name);
         put(m_color_prop, vert_desc, boost::white_color);
 
         if (connect_to_terminals) {
@@ -545,15 +770,14 @@ private:
     {
         using namespace boost;
 
-        put(m_capacity_prop, edge_desc, 0.0);
-        put(m_residual_capacity_prop, edge_desc, 0.0);
+        put(m_capacity_prop, edge_desc, EnergyType(0));
+        put(m_residual_capacity_prop, edge_desc, EnergyType(0));
     }
 
     VertexDescriptor getVertexByName(const std::string& name)
     {
-        auto predicate = [this, name] (VertexDescriptor vert_desc) {
-            auto vertex = m_energy_graph[vert_desc];
-            return name == vertex.name;
+        auto predicate = [this, &name] (VertexDescriptor vert_desc) {
+            return name == vertexName(vert_desc);
         };
 
         return getVertexByPredicate(predicate);
@@ -579,21 +803,25 @@ private:
     }
 
     inline void addTerminalCapacity(VertexDescriptor vertex_desc,
-                                    long source_cap,
-                                    long target_cap)
+                                    EnergyType source_cap,
+                                    EnergyType target_cap)
     {
         using namespace boost;
 
         EdgeDescriptor s_edge, t_edge;
         bool success = false;
 
+        // Shifting both terminal costs by the same amount only changes the
+        // energy by a constant
         if (source_cap < 0) {
-            target_cap += abs(source_cap);
+            target_cap -= source_cap;
+            m_energy_const += source_cap;
             source_cap = 0;
         }
 
         if (target_cap < 0) {
-            source_cap += abs(target_cap);
+            source_cap -= target_cap;
+            m_energy_const += target_cap;
             target_cap = 0;
         }
 
@@ -617,7 +845,7 @@ private:
     }
 
     void addEdge(const VertexDescriptor& vert_u, const VertexDescriptor& vert_v,
-                 long cap, long rev_cap)
+                 EnergyType cap, EnergyType rev_cap)
     {
         using namespace boost;
 
@@ -625,12 +853,12 @@ private:
         bool success;
 
         if (cap < 0) {
-            rev_cap += abs(cap);
+            rev_cap -= cap;
             cap = 0;
         }
 
         if (rev_cap < 0) {
-            cap += abs(rev_cap);
+            cap -= rev_cap;
             rev_cap = 0;
         }
 
@@ -653,7 +881,7 @@ private:
         setReverseEdge(edge_vu, edge_uv);
     }
 
-    inline void setEdgeCapacity(const EdgeDescriptor& edge_desc, long value)
+    inline void setEdgeCapacity(const EdgeDescriptor& edge_desc, EnergyType value)
     {
         auto delta = get(m_capacity_prop, edge_desc);
         value += delta;
@@ -1,9 +1,13 @@
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <exception>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <sstream>
+#include <thread>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
@@ -13,7 +17,9 @@
 #include <boost/numeric/ublas/matrix.hpp>
 
 #include "../common/tuple_helper.h"
+#include "../denoising/condat_denoise.h"
 #include "cmd_helpers.h"
+#include "checkpoint.h"
 #include "binopt.h"
 
 namespace bpo = boost::program_options;
@@ -30,9 +36,34 @@ namespace
             ("input", bpo::value<string>(),
                     "Filename of a matrix market vector file "
                     "containing the denoised input data set")
+            ("lambda", bpo::value<double>(),
+                    "If set, the input is treated as noisy data set and is "
+                    "denoised with this regularization parameter. The plateaus "
+                    "are passed directly to the clustering")
+            ("plateaus", bpo::value<string>(),
+                    "Filename of a CSV file with one (value, length) tuple "
+                    "per plateau, which is clustered instead of 'input'")
+            ("csv-delimiter", bpo::value<string>()->default_value(","),
+                    "Delimiter of the fields of CSV files: a single character, "
+                    "'tab' or 'space'")
+            ("csv-columns", bpo::value<vector<int>>()->multitoken()
+                            ->default_value(vector<int>{ 0, 1 }, "0 1"),
+                    "Columns of the plateau values and lengths in 'plateaus', "
+                    "counted from 0")
+            ("csv-threads", bpo::value<int>()->default_value(0),
+                    "Number of threads parsing CSV files, 0 (default) uses "
+                    "one per core")
+            ("merge-tolerance", bpo::value<double>()->default_value(0.0),
+                    "Neighbouring plateaus, whose values differ by no more "
+                    "than this, are merged before the clustering")
+            ("min-plateau-length", bpo::value<double>()->default_value(1.0),
+                    "Plateaus with fewer samples are merged into the "
+                    "neighbour with the closer value before the clustering")
             ("levels", bpo::value<string>(),
                 "Filename of a matrix market vector file "
-                "containing the level set to culster the datapoints to")
+                "containing the level set to culster the datapoints to. "
+                "Files ending in '.csv' or '.tsv' are read as CSV, one level "
+                "per row")
             ("output", bpo::value<string>()->default_value("-"),
                     "Filename of the matrix market vector file "
                     "the denoised data should be written to")
@@ -46,6 +77,63 @@ namespace
             ("maxiter", bpo::value<int>()->default_value(-1),
                     "Number of alpha expansion iterations, if set to -1 (default) "
                     "a backtracking level proposal strategy is used.")
+            ("seed", bpo::value<uint64_t>(),
+                    "Seed of the random number generator, which orders the "
+                    "levels. Runs with the same seed are reproducible")
+            ("label-order", bpo::value<string>()->default_value("shuffle"),
+                    "Order in which the levels are proposed: 'shuffle', "
+                    "'benefit' (data cost decrease), 'population' or 'round-robin'")
+            ("threads", bpo::value<int>()->default_value(1),
+                    "Number of alpha expansions computed concurrently during "
+                    "a label sweep (only used with 'maxiter' >= 0)")
+            ("local-window", bpo::value<int>()->default_value(0),
+                    "Radius of the windows around relabeled sites, to which "
+                    "the sweeps after the first are restricted. A final "
+                    "global sweep verifies the result. 0 (default) disables it")
+            ("time-budget", bpo::value<double>(),
+                    "Wall-clock seconds after which the optimization stops "
+                    "and keeps the best labeling found so far. Levels with "
+                    "the largest energy decrease are proposed first")
+            ("checkpoint", bpo::value<string>(),
+                    "Filename to which the state of the optimization is "
+                    "written periodically and at the end, see 'resume'")
+            ("checkpoint-interval", bpo::value<double>()->default_value(300.0),
+                    "Seconds between two checkpoints")
+            ("resume", bpo::value<string>(),
+                    "Filename of a checkpoint, from which an interrupted run "
+                    "continues. The input and levels are taken from it, "
+                    "'input', 'levels', 'lambda' and 'init' are ignored")
+            ("coarse-to-fine", bpo::value<int>(),
+                    "Coarsest level stride of a multiresolution expansion. "
+                    "Each pass halves the stride and only proposes levels "
+                    "close to the current assignments. Requires sorted levels")
+            ("init", bpo::value<string>()->default_value("none"),
+                    "Initial labeling: 'none' (all sites on the first level), "
+                    "'random', 'min-data-cost', 'nearest-level' or 'prior'")
+            ("prior-output", bpo::value<string>(),
+                    "Filename of the output vector of an earlier run on the "
+                    "same input, used as initial labeling by '--init prior'")
+            ("fuse-with", bpo::value<vector<string>>()->composing(),
+                    "Filename of the output vector of another run on the same "
+                    "input, which is merged into the result by a fusion move. "
+                    "Can be given multiple times")
+            ("stats-out", bpo::value<string>(),
+                    "Filename of a JSON report with the timings of each "
+                    "processing stage and of every expansion")
+            ("maxflow", bpo::value<string>()->default_value("chain"),
+                    "Max-flow solver of the expansion graphs: 'chain' "
+                    "(dynamic programming on the chain of sites), 'bk' "
+                    "(Boykov-Kolmogorov), 'ibfs' or 'pseudoflow'")
+            ("energy-type", bpo::value<string>()->default_value("int64"),
+                    "Type of the energies and capacities: 'int64', 'int32' or "
+                    "'float'. The costs are scaled down, if the energies could "
+                    "exceed the range of the type")
+            ("dump-maxflow", bpo::value<string>(),
+                    "Prefix of DIMACS files, to which the max-flow instance "
+                    "of every expansion is written (see maxflow_benchmark)")
+            ("capture-maxflow", bpo::value<string>(),
+                    "Binary file, to which the max-flow instances of all "
+                    "expansions are written (see maxflow_benchmark)")
             ("prior-distance", bpo::value<double>(),
                     "The distance of two adjacent steps the prior term should "
                     "NOT penalize")
@@ -53,6 +141,7 @@ namespace
             ("debug-graphstructure", 
                     "Turn on debug output of graphs and capacities after "
                     "each graph-cut. The files are in graphviz dot notation.");
+        cmd::addInputFormatOptions(desc);
 
         return desc;
     }
@@ -79,12 +168,37 @@ namespace
             }
 
             bool is_valid = true;
-            if (! vm.count("input")) {
+            if (! vm.count("input") && ! vm.count("plateaus") && ! vm.count("resume")) {
                 cout << "ERROR: 'input' argument is required" << endl;
                 is_valid = false;
             }
 
-            if (! vm.count("levels")) {
+            if (! cmd::isValidInputFormat(vm))
+                is_valid = false;
+
+            if (vm.count("plateaus") && (vm.count("input") || vm.count("lambda"))) {
+                cout << "ERROR: 'plateaus' cannot be combined with 'input' or 'lambda'" << endl;
+                is_valid = false;
+            }
+
+            auto delimiter = vm["csv-delimiter"].as<string>();
+            if (delimiter.size() != 1 && delimiter != "tab" && delimiter != "space") {
+                cout << "ERROR: 'csv-delimiter' must be a single character, 'tab' or 'space'" << endl;
+                is_valid = false;
+            }
+
+            auto columns = vm["csv-columns"].as<vector<int>>();
+            if (columns.size() != 2 || columns[0] < 0 || columns[1] < 0) {
+                cout << "ERROR: 'csv-columns' must be two non-negative column indices" << endl;
+                is_valid = false;
+            }
+
+            if (vm["csv-threads"].as<int>() < 0) {
+                cout << "ERROR: 'csv-threads' must not be negative" << endl;
+                is_valid = false;
+            }
+
+            if (! vm.count("levels") && ! vm.count("resume")) {
                 cout << "ERROR: 'levels' argument is required" << endl;
                 is_valid = false;
             }
@@ -100,6 +214,57 @@ namespace
                 is_valid = false;
             }
 
+            auto init = vm["init"].as<string>();
+            if (init != "none" && init != "random" && init != "min-data-cost"
+                && init != "nearest-level" && init != "prior") {
+                cout << "ERROR: unknown initialization '" << init << "'" << endl;
+                is_valid = false;
+            }
+
+            auto label_order = vm["label-order"].as<string>();
+            if (label_order != "shuffle" && label_order != "benefit"
+                && label_order != "population" && label_order != "round-robin") {
+                cout << "ERROR: unknown label order '" << label_order << "'" << endl;
+                is_valid = false;
+            }
+
+            auto maxflow = vm["maxflow"].as<string>();
+            if (maxflow != "chain" && maxflow != "bk" && maxflow != "ibfs" && maxflow != "pseudoflow") {
+                cout << "ERROR: unknown max-flow solver '" << maxflow << "'" << endl;
+                is_valid = false;
+            }
+
+            auto energy_type = vm["energy-type"].as<string>();
+            if (energy_type != "int64" && energy_type != "int32" && energy_type != "float") {
+                cout << "ERROR: unknown energy type '" << energy_type << "'" << endl;
+                is_valid = false;
+            }
+
+            if (vm.count("time-budget") && vm["time-budget"].as<double>() <= 0.0) {
+                cout << "ERROR: 'time-budget' must be positive" << endl;
+                is_valid = false;
+            }
+
+            if (vm["merge-tolerance"].as<double>() < 0.0) {
+                cout << "ERROR: 'merge-tolerance' must not be negative" << endl;
+                is_valid = false;
+            }
+
+            if (vm["checkpoint-interval"].as<double>() <= 0.0) {
+                cout << "ERROR: 'checkpoint-interval' must be positive" << endl;
+                is_valid = false;
+            }
+
+            if (vm["local-window"].as<int>() < 0) {
+                cout << "ERROR: 'local-window' must not be negative" << endl;
+                is_valid = false;
+            }
+
+            if (init == "prior" && ! vm.count("prior-output")) {
+                cout << "ERROR: 'prior-output' is required for '--init prior'" << endl;
+                is_valid = false;
+            }
+
             return is_valid;
         }
         catch (error& e)
@@ -110,18 +275,53 @@ namespace
         }
     }
 
+    /**
+     * Upper bound of the energy of any labeling: each site at its most
+     * distant level and each pair of neighbouring sites at different
+     * levels with a penalized step. The smoothness and label energies
+     * visit every pair from both of its sites, so these terms count twice.
+     */
     template <typename VectorType>
-    void registerCostFunctions(BinaryOptimization<> &bin_opt,
-                               VectorType &data,
-                               VectorType &weights,
-                               VectorType &labels,
-                               VectorType &lambdas,
-                               double prior_distance)
+    double maxEnergy(const VectorType &data,
+                     const VectorType &weights,
+                     const VectorType &labels,
+                     const VectorType &lambdas)
+    {
+        using namespace std;
+
+        if (data.size() == 0 || labels.size() == 0)
+            return 0.0;
+
+        double min_label = *min_element(labels.begin(), labels.end());
+        double max_label = *max_element(labels.begin(), labels.end());
+
+        double energy = 0.0;
+        for (size_t i = 0; i < data.size(); i++)
+        {
+            energy += fabs(lambdas[0]) * (1.0 + weights(i))
+                * max(fabs(data(i) - min_label), fabs(data(i) - max_label));
+
+            if (i + 1 < data.size())
+                energy += 2.0 * (fabs(lambdas[1]) * (1.0 + weights(i) + weights(i + 1))
+                                 + fabs(lambdas[2]));
+        }
+
+        return energy;
+    }
+
+    template <typename EnergyType, typename BinOptType, typename VectorType>
+    void registerCostFunctions(BinOptType &bin_opt,
+                               const VectorType &data,
+                               const VectorType &weights,
+                               const VectorType &labels,
+                               const VectorType &lambdas,
+                               double prior_distance,
+                               double cost_scale)
     {
         typedef std::tuple<int, int> DataTuple;
         typedef std::tuple<int, int, int, int> SmoothTuple;
 
-        auto data_cost_fn = [&data, &weights, &labels, &lambdas](const DataTuple &t, int)
+        auto data_cost_fn = [&data, &weights, &labels, &lambdas, cost_scale](const DataTuple &t, int)
         {
             double value  = data(get<0>(t));
             double weight = weights(get<0>(t));
@@ -132,10 +332,10 @@ namespace
                 * abs(value - label_value);
 
             BOOST_ASSERT(cost >= 0);
-            return (long long)(cost);
+            return EnergyType(trunc(cost * cost_scale));
         };
 
-        auto smooth_cost_fn = [&data, &weights, &labels, &lambdas](const SmoothTuple &t, int)
+        auto smooth_cost_fn = [&data, &weights, &labels, &lambdas, cost_scale](const SmoothTuple &t, int)
         {
             double weight_1  = weights(get<0>(t));
             double weight_2  = weights(get<1>(t));
@@ -147,10 +347,10 @@ namespace
                 * (label_1 != label_2 ? 1 : 0);
 
             BOOST_ASSERT(cost >= 0);
-            return (long long)(cost);
+            return EnergyType(trunc(cost * cost_scale));
         };
 
-        auto label_cost_fn = [&data, &weights, &labels, &prior_distance, &lambdas](const SmoothTuple &t, int)
+        auto label_cost_fn = [&data, &weights, &labels, prior_distance, &lambdas, cost_scale](const SmoothTuple &t, int)
         {
             double weight_1     = weights(get<0>(t));
             double weight_2     = weights(get<1>(t));
@@ -166,7 +366,7 @@ namespace
                 * (delta > epsilon ? 1 : 0)*(label_1 != label_2 ? 1 : 0);
 
             BOOST_ASSERT(cost >= 0);
-            return (long long)(cost);
+            return EnergyType(trunc(cost * cost_scale));
         };
 
         bin_opt.setDataCost(data_cost_fn);
@@ -184,8 +384,8 @@ namespace
         return false;
     }
 
-    template <typename MatType, typename VectorType>
-    void collectAssignments(BinaryOptimization<> &bin_opt,
+    template <typename BinOptType, typename MatType, typename VectorType>
+    void collectAssignments(BinOptType &bin_opt,
                             const VectorType &weights,
                             const VectorType &labels,
 		    	            MatType &mat)
@@ -204,11 +404,11 @@ namespace
         }
     }
 
-    template <typename VectorType>
+    template <typename BinOptType, typename VectorType>
     bool saveAssignments(const bpo::variables_map &vm,
                          const VectorType &weights,
                          const VectorType &labels,
-		                 BinaryOptimization<> &bin_opt)
+		                 BinOptType &bin_opt)
     {
         using namespace std;
 
@@ -218,9 +418,9 @@ namespace
         return cmd::saveOutputMatrix(vm, assignments); 
     }
 
-    template <typename VectorType>
+    template <typename BinOptType, typename VectorType>
     void postprocessAssignments(const bpo::variables_map &vm,
-		    		            BinaryOptimization<> &bin_opt,
+		    		            BinOptType &bin_opt,
 				                const VectorType &input,
 				                const VectorType &weights,
 				                const VectorType &labels,
@@ -252,26 +452,325 @@ namespace
         //BOOST_LOG_TRIVIAL(debug) << "Output size:  " << output.size();
     }
 
-    int runProgram(const bpo::options_description& desc,
-                   const bpo::variables_map& vm)
+    char csvDelimiter(const bpo::variables_map &vm)
+    {
+        auto delimiter = vm["csv-delimiter"].as<std::string>();
+        if (delimiter == "tab")
+            return '\t';
+        if (delimiter == "space")
+            return ' ';
+
+        return delimiter[0];
+    }
+
+    int csvThreads(const bpo::variables_map &vm)
+    {
+        int n_threads = vm["csv-threads"].as<int>();
+        if (n_threads == 0)
+            n_threads = std::max(1u, std::thread::hardware_concurrency());
+
+        return n_threads;
+    }
+
+    /**
+     * Loads precomputed (value, length) tuples from the 'plateaus' CSV
+     * file. The lengths have to be whole numbers of samples, their sum is
+     * the length of the output. Only the length of the input is used
+     * after the compression, its samples stay zero.
+     */
+    template <typename VectorType>
+    bool loadPlateaus(const bpo::variables_map &vm,
+                      VectorType &input,
+                      VectorType &data,
+                      VectorType &weights,
+                      VectorType &output)
     {
         using namespace std;
-        typedef boost::numeric::ublas::vector<double> VectorType;
-        
-        VectorType input, levels, output;
 
-        if (! cmd::loadInputVectorAndAdjustOthers(vm, input, output))
-            return cmd::ERROR_UNHANDLED_EXCEPTION;
-        BOOST_LOG_TRIVIAL(debug) << "Loaded input vector with " << input.size() << " samples.";
+        auto filename = vm["plateaus"].as<string>();
+        auto columns = vm["csv-columns"].as<vector<int>>();
 
-        if (! cmd::loadLevelsVector(vm, levels))
-            return cmd::ERROR_UNHANDLED_EXCEPTION;
-        BOOST_LOG_TRIVIAL(debug) << "Loaded levels vector with " << levels.size() << " elements.";
-        
-        VectorType data, weights;
-        helpers::postprocessTVDNData(input, data, weights);
-        BOOST_LOG_TRIVIAL(debug) << "Compressed input vector into " << data.size()
-                                 << " (data, weight) tuples.";
+        vector<double> values, lengths;
+        if (! cmd::tryLoadDataAndWeights(filename, values, lengths, csvDelimiter(vm),
+                                         columns[0], columns[1], csvThreads(vm)))
+            return false;
+
+        double n_samples = 0.0;
+        for (size_t i = 0; i < lengths.size(); i++) {
+            if (lengths[i] < 1.0 || lengths[i] != floor(lengths[i])) {
+                BOOST_LOG_TRIVIAL(error) << "Plateau " << i << " of '" << filename
+                                         << "' has the invalid length " << lengths[i];
+                return false;
+            }
+            n_samples += lengths[i];
+        }
+
+        input = boost::numeric::ublas::zero_vector<double>(n_samples);
+        output.resize(input.size());
+
+        data.resize(values.size());
+        copy(values.begin(), values.end(), data.begin());
+        weights.resize(lengths.size());
+        copy(lengths.begin(), lengths.end(), weights.begin());
+
+        return true;
+    }
+
+    template <typename VectorType>
+    bool loadLevels(const bpo::variables_map &vm,
+                    VectorType &levels)
+    {
+        using namespace std;
+
+        auto filename = vm["levels"].as<string>();
+        if (! boost::algorithm::iends_with(filename, ".csv") && ! boost::algorithm::iends_with(filename, ".tsv"))
+            return cmd::loadLevelsVector(vm, levels);
+
+        vector<double> values;
+        if (! cmd::tryLoadLabels(filename, values, csvDelimiter(vm)))
+            return false;
+
+        levels.resize(values.size());
+        copy(values.begin(), values.end(), levels.begin());
+        return true;
+    }
+
+    template <typename VectorType>
+    void denoiseToPlateaus(const VectorType &input,
+                           const double lambda,
+                           VectorType &data,
+                           VectorType &weights)
+    {
+        helpers::PlateauCollector plateaus;
+        TV1D_denoise_segments(&input[0], input.size(), lambda, plateaus);
+
+        plateaus.copyTo(data, weights);
+    }
+
+    template <typename VectorType>
+    std::vector<int> snapToNearestLevels(const VectorType &values,
+                                         const VectorType &levels)
+    {
+        using namespace std;
+
+        vector<int> order(levels.size());
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = i;
+
+        sort(order.begin(), order.end(), [&levels](int a, int b) {
+            return levels(a) < levels(b);
+        });
+
+        vector<int> assignments(values.size());
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            auto it = lower_bound(order.begin(), order.end(), values(i),
+                                  [&levels](int l, double v) { return levels(l) < v; });
+
+            if (it == order.end())
+                --it;
+            else if (it != order.begin()
+                     && values(i) - levels(*(it - 1)) < levels(*it) - values(i))
+                --it;
+
+            assignments[i] = *it;
+        }
+
+        return assignments;
+    }
+
+    template <typename VectorType>
+    bool loadPlateauValuesOfOutput(const std::string &filename,
+                                   const VectorType &input,
+                                   const VectorType &weights,
+                                   VectorType &prior_data)
+    {
+        using namespace std;
+
+        VectorType prior;
+        if (! cmd::loadVector(filename, prior))
+            return false;
+
+        if (prior.size() != input.size()) {
+            BOOST_LOG_TRIVIAL(error) << "The prior output has " << prior.size()
+                                     << " samples, but the input " << input.size();
+            return false;
+        }
+
+        // the prior output is constant on each plateau, take its first sample
+        prior_data.resize(weights.size());
+        size_t sample = 0;
+        for (size_t i = 0; i < weights.size(); i++) {
+            prior_data(i) = prior(sample);
+            sample += weights(i);
+        }
+
+        return true;
+    }
+
+    template <typename BinOptType>
+    typename BinOptType::LabelOrdering parseLabelOrdering(const std::string &label_order)
+    {
+        if (label_order == "benefit")
+            return BinOptType::DATA_COST_BENEFIT;
+        if (label_order == "population")
+            return BinOptType::POPULATION;
+        if (label_order == "round-robin")
+            return BinOptType::ROUND_ROBIN;
+
+        return BinOptType::SHUFFLE;
+    }
+
+    template <typename BinOptType>
+    typename BinOptType::MaxFlowAlgorithm parseMaxFlowAlgorithm(const std::string &maxflow)
+    {
+        typedef typename BinOptType::EnergyGraphType EnergyGraphType;
+
+        if (maxflow == "ibfs")
+            return EnergyGraphType::IBFS;
+        if (maxflow == "pseudoflow")
+            return EnergyGraphType::PSEUDOFLOW;
+
+        return EnergyGraphType::BOYKOV_KOLMOGOROV;
+    }
+
+    template <typename EnergyType, typename BinOptType, typename VectorType>
+    bool initializeLabels(const bpo::variables_map &vm,
+                          BinOptType &bin_opt,
+                          const VectorType &input,
+                          const VectorType &data,
+                          const VectorType &weights,
+                          const VectorType &levels)
+    {
+        using namespace std;
+
+        auto init = vm["init"].as<string>();
+        EnergyType energy = 0;
+
+        if (init == "none") {
+            return true;
+        }
+        else if (init == "random") {
+            energy = bin_opt.initiallyAssignLabels(BinOptType::RANDOM);
+        }
+        else if (init == "min-data-cost") {
+            energy = bin_opt.initiallyAssignLabels(BinOptType::MIN_DATA_COST);
+        }
+        else if (init == "nearest-level") {
+            energy = bin_opt.initiallyAssignLabels(snapToNearestLevels(data, levels));
+        }
+        else {
+            VectorType prior_data;
+            if (! loadPlateauValuesOfOutput(vm["prior-output"].as<string>(),
+                                            input, weights, prior_data))
+                return false;
+
+            energy = bin_opt.initiallyAssignLabels(snapToNearestLevels(prior_data, levels));
+        }
+
+        BOOST_LOG_TRIVIAL(debug) << "Initial labeling '" << init << "' has energy " << energy;
+        return true;
+    }
+
+    template <typename EnergyType, typename BinOptType, typename VectorType>
+    bool fuseWithOtherResults(const bpo::variables_map &vm,
+                              BinOptType &bin_opt,
+                              const VectorType &input,
+                              const VectorType &weights,
+                              const VectorType &levels,
+                              EnergyType &energy)
+    {
+        using namespace std;
+
+        if (! vm.count("fuse-with"))
+            return true;
+
+        for (auto &filename : vm["fuse-with"].as<vector<string>>())
+        {
+            VectorType other_data;
+            if (! loadPlateauValuesOfOutput(filename, input, weights, other_data))
+                return false;
+
+            energy = bin_opt.fuse(snapToNearestLevels(other_data, levels));
+            BOOST_LOG_TRIVIAL(debug) << "Energy after fusion with '" << filename
+                                     << "': " << energy;
+        }
+
+        return true;
+    }
+
+    template <typename EnergyType>
+    bool saveStatisticsReport(const bpo::variables_map &,
+                              const StageTimes &,
+                              const NoExpansionStatistics &,
+                              EnergyType,
+                              bool)
+    {
+        return true;
+    }
+
+    template <typename EnergyType>
+    bool saveStatisticsReport(const bpo::variables_map &vm,
+                              const StageTimes &stage_times,
+                              const ExpansionStatistics<EnergyType> &statistics,
+                              EnergyType energy,
+                              bool is_completed)
+    {
+        using namespace std;
+
+        return cmd::saveStatisticsReport(vm["stats-out"].as<string>(),
+                                         stage_times,
+                                         statistics.records(),
+                                         energy,
+                                         is_completed,
+                                         peakResidentSetSize());
+    }
+
+    /**
+     * Writes the state of bin_opt together with the plateaus and levels to
+     * the 'checkpoint' file every 'checkpoint-interval' seconds, on a
+     * background thread.
+     */
+    template <typename BinOptType, typename VectorType>
+    std::shared_ptr<CheckpointWriter> enableCheckpoints(const bpo::variables_map &vm,
+                                                        BinOptType &bin_opt,
+                                                        const VectorType &input,
+                                                        const VectorType &data,
+                                                        const VectorType &weights,
+                                                        const VectorType &levels,
+                                                        Checkpoint &checkpoint)
+    {
+        using namespace std;
+
+        checkpoint.num_samples = input.size();
+        checkpoint.data.assign(data.begin(), data.end());
+        checkpoint.weights.assign(weights.begin(), weights.end());
+        checkpoint.levels.assign(levels.begin(), levels.end());
+
+        auto writer = make_shared<CheckpointWriter>(vm["checkpoint"].as<string>());
+        bin_opt.setCheckpointFn([writer, &checkpoint](const OptimizationState &state) {
+            Checkpoint copy = checkpoint;
+            copy.state = state;
+            if (! writer->writeAsync(move(copy)))
+                BOOST_LOG_TRIVIAL(debug) << "Previous checkpoint still being written, skipping";
+        }, vm["checkpoint-interval"].as<double>());
+
+        return writer;
+    }
+
+    template <typename EnergyType, typename BinOptType, typename VectorType>
+    int optimizeAndSaveAssignments(const bpo::variables_map& vm,
+                                   StageTimes &stage_times,
+                                   const VectorType &input,
+                                   const VectorType &data,
+                                   const VectorType &weights,
+                                   const VectorType &levels,
+                                   const OptimizationState &resume_state,
+                                   VectorType &output)
+    {
+        using namespace std;
+
+        stage_times.start();
 
         VectorType lambdas;
         cmd::loadLambdas(vm, lambdas);
@@ -280,31 +779,268 @@ namespace
                                     ? vm["prior-distance"].as<double>()
                                     : 0.0;
 
-        BinaryOptimization<> bin_opt(data.size(), levels.size());
+        double max_energy = maxEnergy(data, weights, levels, lambdas);
+        double cost_scale = helpers::energyScale<EnergyType>(max_energy);
+        if (cost_scale < 1.0)
+            BOOST_LOG_TRIVIAL(warning) << "Energies up to " << max_energy << " exceed the range of '"
+                                       << vm["energy-type"].as<string>() << "', costs are scaled by "
+                                       << cost_scale;
+
+        BinOptType bin_opt(data.size(), levels.size());
         if (vm.count("debug-graphstructure"))
             bin_opt.recordEnergyGraphDumps();
+        bin_opt.setNumThreads(vm["threads"].as<int>());
+        bin_opt.setLocalWindowRadius(vm["local-window"].as<int>());
+        bin_opt.setLabelOrdering(parseLabelOrdering<BinOptType>(vm["label-order"].as<string>()));
+        bin_opt.setMaxFlowAlgorithm(parseMaxFlowAlgorithm<BinOptType>(vm["maxflow"].as<string>()));
+        if (vm.count("dump-maxflow"))
+            bin_opt.recordMaxFlowDumps(vm["dump-maxflow"].as<string>());
+        if (vm.count("capture-maxflow")
+            && ! bin_opt.recordMaxFlowCapture(vm["capture-maxflow"].as<string>())) {
+            BOOST_LOG_TRIVIAL(error) << "Unable to write the max-flow capture '"
+                                     << vm["capture-maxflow"].as<string>() << "'";
+            return cmd::ERROR_UNHANDLED_EXCEPTION;
+        }
+        if (vm.count("seed"))
+            bin_opt.setSeed(vm["seed"].as<uint64_t>());
 
-        registerCostFunctions(bin_opt, 
-                              data,
-                              weights, 
-                              levels, 
-                              lambdas, 
-                              prior_distance);
+        registerCostFunctions<EnergyType>(bin_opt,
+                                          data,
+                                          weights,
+                                          levels,
+                                          lambdas,
+                                          prior_distance,
+                                          cost_scale);
 
-        auto energy = bin_opt.expansion(vm["maxiter"].as<int>());
-        
+        if (vm.count("resume")) {
+            EnergyType energy = bin_opt.restoreState(resume_state);
+            BOOST_LOG_TRIVIAL(debug) << "Resumed after " << bin_opt.numExpansions()
+                                     << " expansions with energy " << energy;
+        }
+        else if (! initializeLabels<EnergyType>(vm, bin_opt, input, data, weights, levels)) {
+            return cmd::ERROR_UNHANDLED_EXCEPTION;
+        }
+
+        Checkpoint checkpoint;
+        shared_ptr<CheckpointWriter> checkpoint_writer;
+        if (vm.count("checkpoint"))
+            checkpoint_writer = enableCheckpoints(vm, bin_opt, input, data, weights, levels, checkpoint);
+
+        if (vm.count("time-budget"))
+            bin_opt.setTimeBudget(vm["time-budget"].as<double>());
+
+        EnergyType energy = vm.count("coarse-to-fine")
+                        ? bin_opt.expansionCoarseToFine(vm["coarse-to-fine"].as<int>(),
+                                                        vm["maxiter"].as<int>())
+                        : bin_opt.expansion(vm["maxiter"].as<int>());
+        if (! fuseWithOtherResults(vm, bin_opt, input, weights, levels, energy))
+            return cmd::ERROR_UNHANDLED_EXCEPTION;
+
+        BOOST_LOG_TRIVIAL(debug) << "Reached energy " << energy << " after "
+                                 << bin_opt.numExpansions() << " expansions, "
+                                 << bin_opt.numSkippedExpansions() << " skipped.";
+        if (bin_opt.isTimeBudgetExhausted())
+            BOOST_LOG_TRIVIAL(warning) << "Time budget of " << vm["time-budget"].as<double>()
+                                       << " s exhausted, keeping the labeling with energy "
+                                       << energy;
+
+        // The final state, so a run cut short by the time budget can be
+        // continued as well
+        if (checkpoint_writer) {
+            checkpoint_writer->wait();
+            bin_opt.exportState(checkpoint.state);
+            if (! saveCheckpoint(vm["checkpoint"].as<string>(), checkpoint))
+                BOOST_LOG_TRIVIAL(error) << "Unable to write the checkpoint '"
+                                         << vm["checkpoint"].as<string>() << "'";
+        }
+        stage_times.stop("optimization");
+
+        stage_times.start();
         if (areAssignmentsRequested(vm)) {
             saveAssignments(vm, weights, levels, bin_opt);
-            return cmd::SUCCESS;
         }
+        else {
+            postprocessAssignments(vm, bin_opt, input, weights, levels, output); 
 
-        postprocessAssignments(vm, bin_opt, input, weights, levels, output); 
+            if (! cmd::saveOutputVector(vm, output))
+                return cmd::ERROR_UNHANDLED_EXCEPTION;
+        }
+        stage_times.stop("output");
 
-        if (! cmd::saveOutputVector(vm, output))
+        if (! saveStatisticsReport(vm, stage_times, bin_opt.statistics(), energy,
+                                   ! bin_opt.isTimeBudgetExhausted()))
             return cmd::ERROR_UNHANDLED_EXCEPTION;
 
         return cmd::SUCCESS;
     }
+
+    // The chain solver is selected at compile time, it replaces the
+    // EnergyGraph of the expansions by a ChainEnergy
+    template <typename EnergyType, typename StatisticsPolicy, typename VectorType>
+    int optimizeWithStatistics(const bpo::variables_map& vm,
+                               StageTimes &stage_times,
+                               const VectorType &input,
+                               const VectorType &data,
+                               const VectorType &weights,
+                               const VectorType &levels,
+                               const OptimizationState &resume_state,
+                               VectorType &output)
+    {
+        if (vm["maxflow"].as<std::string>() == "chain") {
+            typedef BinaryOptimization<EnergyType, int, int, int, StatisticsPolicy,
+                                       ChainEnergy<EnergyType>> ChainBinOpt;
+            return optimizeAndSaveAssignments<EnergyType, ChainBinOpt>(vm, stage_times, input,
+                                                                       data, weights, levels,
+                                                                       resume_state, output);
+        }
+
+        typedef BinaryOptimization<EnergyType, int, int, int, StatisticsPolicy> GraphBinOpt;
+        return optimizeAndSaveAssignments<EnergyType, GraphBinOpt>(vm, stage_times, input,
+                                                                   data, weights, levels,
+                                                                   resume_state, output);
+    }
+
+    // The instrumented optimizer is only instantiated, if a report is
+    // requested, otherwise the statistics compile away
+    template <typename EnergyType, typename VectorType>
+    int optimizeWithEnergyType(const bpo::variables_map& vm,
+                               StageTimes &stage_times,
+                               const VectorType &input,
+                               const VectorType &data,
+                               const VectorType &weights,
+                               const VectorType &levels,
+                               const OptimizationState &resume_state,
+                               VectorType &output)
+    {
+        if (vm.count("stats-out"))
+            return optimizeWithStatistics<EnergyType, ExpansionStatistics<EnergyType>>(
+                    vm, stage_times, input, data, weights, levels, resume_state, output);
+
+        return optimizeWithStatistics<EnergyType, NoExpansionStatistics>(
+                vm, stage_times, input, data, weights, levels, resume_state, output);
+    }
+
+    /**
+     * Takes the plateaus and levels of a checkpoint instead of loading and
+     * compressing the input. Only the length of the input is used after
+     * the compression, its samples stay zero.
+     */
+    template <typename VectorType>
+    bool loadResumedCheckpoint(const std::string &filename,
+                               Checkpoint &checkpoint,
+                               VectorType &input,
+                               VectorType &data,
+                               VectorType &weights,
+                               VectorType &levels,
+                               VectorType &output)
+    {
+        using namespace std;
+
+        if (! loadCheckpoint(filename, checkpoint)) {
+            BOOST_LOG_TRIVIAL(error) << "'" << filename << "' is not a checkpoint";
+            return false;
+        }
+
+        auto &labels = checkpoint.state.labels;
+        bool is_valid = checkpoint.weights.size() == checkpoint.data.size()
+                     && labels.size() == checkpoint.data.size();
+        for (auto label : labels)
+            is_valid = is_valid && label >= 0 && label < (int)checkpoint.levels.size();
+        is_valid = is_valid && hasDistinctLabels(checkpoint.state.label_table, checkpoint.levels.size());
+
+        if (! is_valid) {
+            BOOST_LOG_TRIVIAL(error) << "The checkpoint '" << filename << "' is inconsistent";
+            return false;
+        }
+
+        input = boost::numeric::ublas::zero_vector<double>(checkpoint.num_samples);
+        output.resize(checkpoint.num_samples);
+
+        data.resize(checkpoint.data.size());
+        copy(checkpoint.data.begin(), checkpoint.data.end(), data.begin());
+        weights.resize(checkpoint.weights.size());
+        copy(checkpoint.weights.begin(), checkpoint.weights.end(), weights.begin());
+        levels.resize(checkpoint.levels.size());
+        copy(checkpoint.levels.begin(), checkpoint.levels.end(), levels.begin());
+
+        BOOST_LOG_TRIVIAL(debug) << "Resuming from '" << filename << "' with " << data.size()
+                                 << " plateaus of " << input.size() << " samples and "
+                                 << levels.size() << " levels.";
+        return true;
+    }
+
+    int runProgram(const bpo::options_description& desc,
+                   const bpo::variables_map& vm)
+    {
+        using namespace std;
+        typedef boost::numeric::ublas::vector<double> VectorType;
+        
+        VectorType input, levels, output;
+        VectorType data, weights;
+        StageTimes stage_times;
+        Checkpoint resumed;
+
+        if (vm.count("resume")) {
+            stage_times.start();
+            if (! loadResumedCheckpoint(vm["resume"].as<string>(), resumed,
+                                        input, data, weights, levels, output))
+                return cmd::ERROR_UNHANDLED_EXCEPTION;
+            stage_times.stop("resume");
+        }
+        else {
+            stage_times.start();
+            if (vm.count("plateaus")) {
+                if (! loadPlateaus(vm, input, data, weights, output))
+                    return cmd::ERROR_UNHANDLED_EXCEPTION;
+                BOOST_LOG_TRIVIAL(debug) << "Loaded " << data.size() << " (data, weight) tuples of "
+                                         << input.size() << " samples.";
+            }
+            else {
+                if (! cmd::loadInputVectorAndAdjustOthers(vm, input, output))
+                    return cmd::ERROR_UNHANDLED_EXCEPTION;
+                BOOST_LOG_TRIVIAL(debug) << "Loaded input vector with " << input.size() << " samples.";
+            }
+
+            if (! loadLevels(vm, levels))
+                return cmd::ERROR_UNHANDLED_EXCEPTION;
+            BOOST_LOG_TRIVIAL(debug) << "Loaded levels vector with " << levels.size() << " elements.";
+            stage_times.stop("load");
+
+            if (! vm.count("plateaus")) {
+                stage_times.start();
+                if (vm.count("lambda"))
+                    denoiseToPlateaus(input, vm["lambda"].as<double>(), data, weights);
+                else
+                    helpers::postprocessTVDNData(input, data, weights);
+                BOOST_LOG_TRIVIAL(debug) << "Compressed input vector into " << data.size()
+                                         << " (data, weight) tuples.";
+                stage_times.stop("rle");
+            }
+
+            auto tolerance = vm["merge-tolerance"].as<double>();
+            auto min_length = vm["min-plateau-length"].as<double>();
+            if (tolerance > 0.0 || min_length > 1.0) {
+                stage_times.start();
+                size_t n_plateaus = data.size();
+                helpers::mergePlateaus(data, weights, tolerance, min_length);
+                BOOST_LOG_TRIVIAL(debug) << "Merged " << n_plateaus << " plateaus into " << data.size()
+                                         << " (" << 100.0 * (n_plateaus - data.size()) / max<size_t>(n_plateaus, 1)
+                                         << " % fewer sites).";
+                stage_times.stop("merge");
+            }
+        }
+
+        auto energy_type = vm["energy-type"].as<string>();
+        if (energy_type == "int32")
+            return optimizeWithEnergyType<int32_t>(vm, stage_times, input, data, weights,
+                                                   levels, resumed.state, output);
+        if (energy_type == "float")
+            return optimizeWithEnergyType<float>(vm, stage_times, input, data, weights,
+                                                 levels, resumed.state, output);
+
+        return optimizeWithEnergyType<long long>(vm, stage_times, input, data, weights,
+                                                 levels, resumed.state, output);
+    }
 }
 
 int main(const int argc, const char *argv[])
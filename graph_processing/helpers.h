@@ -1,7 +1,9 @@
 #ifndef GRAPHHELPERS_H
 #define GRAPHHELPERS_H
 
+#include <cmath>
 #include <iostream>
+#include <limits>
 #include <boost/graph/adjacency_list.hpp>
 
 #include "../common/helpers.h"
@@ -136,6 +138,24 @@ namespace helpers
         return *max_cost_it;
     }
 
+    /**
+     * Factor the costs are multiplied with, so that energies up to
+     * max_energy are exactly representable in EnergyType. Floating point
+     * energies are kept integral as well, which keeps their flows exact.
+     * Three bits are left for the capacities the terms are decomposed into.
+     */
+    template <typename EnergyType>
+    double energyScale(double max_energy)
+    {
+        const int headroom_bits = 3;
+        double max_exact = std::ldexp(1.0, std::numeric_limits<EnergyType>::digits - headroom_bits);
+
+        if (max_energy <= max_exact)
+            return 1.0;
+
+        return max_exact / max_energy;
+    }
+
     inline long long discretizeAndReweightCost(double cost, long long max_cost)
     {
         if (max_cost <= 0)
@@ -0,0 +1,621 @@
+#ifndef IBFS_MAX_FLOW_H
+#define IBFS_MAX_FLOW_H
+
+#include <vector>
+#include <utility>
+#include <limits>
+
+#include <boost/assert.hpp>
+#include <boost/property_map/property_map.hpp>
+#include <boost/graph/graph_concepts.hpp>
+#include <boost/graph/properties.hpp>
+#include <boost/concept/assert.hpp>
+
+#include "bk_max_flow.h"
+#include "maxflow_counters.h"
+
+/**
+ * Per-vertex state and queues of ibfs_max_flow, which can be kept alive
+ * between max-flow calls like bk_max_flow_workspace.
+ */
+template <class Graph>
+struct ibfs_max_flow_workspace
+{
+    typedef typename boost::graph_traits<Graph>::vertex_descriptor vertex_descriptor;
+    typedef typename boost::graph_traits<Graph>::edge_descriptor edge_descriptor;
+
+    void reset(std::size_t n_verts)
+    {
+        has_parent.assign(n_verts, false);
+        labels.assign(n_verts, 0);
+        list_ids.assign(n_verts, 0);
+        predecessors.resize(n_verts);
+        source_layer.clear();
+        source_next_layer.clear();
+        sink_layer.clear();
+        sink_next_layer.clear();
+        orphans.reset(n_verts);
+    }
+
+    std::vector<bool> has_parent;
+    std::vector<long> labels;
+    std::vector<unsigned char> list_ids;
+    std::vector<edge_descriptor> predecessors;
+    std::vector<vertex_descriptor> source_layer;
+    std::vector<vertex_descriptor> source_next_layer;
+    std::vector<vertex_descriptor> sink_layer;
+    std::vector<vertex_descriptor> sink_next_layer;
+    detail::bk_ring_buffer<vertex_descriptor> orphans;
+};
+
+namespace detail
+{
+
+using namespace boost;
+
+/**
+ * Incremental breadth-first search max-flow of A. V. Goldberg, S. Hed,
+ * H. Kaplan, R. E. Tarjan and R. F. Werneck, "Maximum flows by incremental
+ * breadth-first search" (2011).
+ *
+ * Like Boykov-Kolmogorov it grows a source tree (black) and a sink tree
+ * (white), but the trees are breadth-first trees with exact distance labels.
+ * They are grown layer by layer, always the tree with the smaller frontier.
+ * An orphan is adopted by a vertex one layer closer to its terminal, which
+ * needs no walk to the root. If there is none it is relabeled to the lowest
+ * possible layer (its children become orphans) or dropped from the tree.
+ * Labels never decrease, which bounds the work of each adoption stage.
+ * Vertices of the trees which gain a residual arc to a free vertex are
+ * scanned again, so the algorithm stops only if one tree is closed.
+ */
+template <class Graph,
+         class EdgeCapacityMap,
+         class ResidualCapacityEdgeMap,
+         class ReverseEdgeMap,
+         class ColorMap,
+         class IndexMap,
+         class Counters = NoMaxFlowCounters>
+class ibfs_max_flow
+{
+    typedef typename property_traits<EdgeCapacityMap>::value_type tEdgeVal;
+    typedef graph_traits<Graph> tGraphTraits;
+    typedef typename tGraphTraits::vertex_iterator vertex_iterator;
+    typedef typename tGraphTraits::vertex_descriptor vertex_descriptor;
+    typedef typename tGraphTraits::edge_descriptor edge_descriptor;
+    typedef typename tGraphTraits::edge_iterator edge_iterator;
+    typedef typename tGraphTraits::out_edge_iterator out_edge_iterator;
+    typedef typename property_traits<ColorMap>::value_type tColorValue;
+    typedef color_traits<tColorValue> tColorTraits;
+
+    // list a vertex is queued in, see push_to_layer()
+    enum { NO_LIST = 0, SOURCE_LAYER, SOURCE_NEXT_LAYER, SINK_LAYER, SINK_NEXT_LAYER };
+
+public:
+    ibfs_max_flow(Graph& g,
+                  EdgeCapacityMap cap,
+                  ResidualCapacityEdgeMap res,
+                  ReverseEdgeMap rev,
+                  ColorMap color,
+                  IndexMap idx,
+                  vertex_descriptor src,
+                  vertex_descriptor sink,
+                  ibfs_max_flow_workspace<Graph>& workspace,
+                  Counters& counters):
+        m_g(g),
+        m_index_map(idx),
+        m_cap_map(cap),
+        m_res_cap_map(res),
+        m_rev_edge_map(rev),
+        m_tree_map(color),
+        m_source(src),
+        m_sink(sink),
+        m_ws((workspace.reset(num_vertices(g)), workspace)),
+        m_flow(0),
+        m_source_height(0),
+        m_sink_height(0),
+        m_counters(counters)
+    {
+        vertex_iterator vi, v_end;
+        for(boost::tie(vi, v_end) = vertices(m_g); vi != v_end; ++vi)
+        {
+            put(m_tree_map, *vi, tColorTraits::gray());
+        }
+        edge_iterator ei, e_end;
+        for(boost::tie(ei, e_end) = edges(m_g); ei != e_end; ++ei)
+        {
+            put(m_res_cap_map, *ei, get(m_cap_map, *ei));
+            BOOST_ASSERT(get(m_rev_edge_map, get(m_rev_edge_map, *ei)) == *ei);
+        }
+        put(m_tree_map, m_source, tColorTraits::black());
+        put(m_tree_map, m_sink, tColorTraits::white());
+        push_to_layer(m_source);
+        push_to_layer(m_sink);
+    }
+
+    tEdgeVal max_flow()
+    {
+        while(true)
+        {
+            if(!advance_layer(m_ws.source_layer, m_ws.source_next_layer,
+                              SOURCE_LAYER, SOURCE_NEXT_LAYER, m_source_height))
+                break;
+            if(!advance_layer(m_ws.sink_layer, m_ws.sink_next_layer,
+                              SINK_LAYER, SINK_NEXT_LAYER, m_sink_height))
+                break;
+
+            if(m_ws.source_layer.size() <= m_ws.sink_layer.size())
+                grow_layer(m_ws.source_layer, SOURCE_LAYER, true);
+            else
+                grow_layer(m_ws.sink_layer, SINK_LAYER, false);
+        }
+        return m_flow;
+    }
+
+protected:
+    /**
+     * if all vertices of the current layer are scanned, the next layer
+     * becomes the current one. Returns false if the tree is closed, i.e.
+     * no more augmenting paths exist.
+     */
+    bool advance_layer(std::vector<vertex_descriptor>& layer,
+                       std::vector<vertex_descriptor>& next_layer,
+                       unsigned char list_id,
+                       unsigned char next_list_id,
+                       long& height)
+    {
+        if(!layer.empty())
+            return true;
+        if(next_layer.empty())
+            return false;
+        layer.swap(next_layer);
+        for(std::size_t i = 0; i < layer.size(); ++i)
+        {
+            if(list_id_of(layer[i]) == next_list_id)
+                list_id_of(layer[i]) = list_id;
+        }
+        ++height;
+        return true;
+    }
+
+    /**
+     * scans all vertices of the current layer of the source (or sink) tree,
+     * including the ones that are queued while the layer is processed
+     */
+    void grow_layer(std::vector<vertex_descriptor>& layer, unsigned char list_id, bool source_tree)
+    {
+        const tColorValue tree = source_tree ? tColorTraits::black() : tColorTraits::white();
+        const long& height = source_tree ? m_source_height : m_sink_height;
+
+        for(std::size_t i = 0; i < layer.size(); ++i)
+        {
+            const vertex_descriptor v = layer[i];
+            if(list_id_of(v) != list_id)
+                continue; //stale entry, the vertex was queued elsewhere
+            list_id_of(v) = NO_LIST;
+
+            if(get(m_tree_map, v) != tree || !is_rooted(v))
+                continue; //dropped from the tree, or orphan which will be queued again
+            if(label_of(v) > height)
+            {
+                push_to_layer(v);
+                continue;
+            }
+
+            if(source_tree)
+                scan_source_vertex(v);
+            else
+                scan_sink_vertex(v);
+        }
+        layer.clear();
+    }
+
+    void scan_source_vertex(vertex_descriptor v)
+    {
+        const long label = label_of(v);
+        out_edge_iterator ei, e_end;
+        for(boost::tie(ei, e_end) = out_edges(v, m_g); ei != e_end; ++ei)
+        {
+            const edge_descriptor out_edge = *ei;
+            m_counters.countEdgeScan();
+            while(get(m_res_cap_map, out_edge) > 0)
+            {
+                const vertex_descriptor other_node = target(out_edge, m_g);
+                const tColorValue other_tree = get(m_tree_map, other_node);
+                if(other_tree == tColorTraits::gray())
+                {
+                    put(m_tree_map, other_node, tColorTraits::black());
+                    set_edge_to_parent(other_node, out_edge, label + 1);
+                    push_to_layer(other_node);
+                    break;
+                }
+                if(other_tree == tColorTraits::black())
+                    break;
+
+                augment(out_edge);
+                adopt();
+                if(get(m_tree_map, v) != tColorTraits::black() || !is_rooted(v) || label_of(v) != label)
+                    return; //v was dropped or relabeled, in the latter case it is queued again
+            }
+        }
+    }
+
+    void scan_sink_vertex(vertex_descriptor v)
+    {
+        const long label = label_of(v);
+        out_edge_iterator ei, e_end;
+        for(boost::tie(ei, e_end) = out_edges(v, m_g); ei != e_end; ++ei)
+        {
+            const edge_descriptor in_edge = get(m_rev_edge_map, *ei);
+            m_counters.countEdgeScan();
+            while(get(m_res_cap_map, in_edge) > 0)
+            {
+                const vertex_descriptor other_node = source(in_edge, m_g);
+                const tColorValue other_tree = get(m_tree_map, other_node);
+                if(other_tree == tColorTraits::gray())
+                {
+                    put(m_tree_map, other_node, tColorTraits::white());
+                    set_edge_to_parent(other_node, in_edge, label + 1);
+                    push_to_layer(other_node);
+                    break;
+                }
+                if(other_tree == tColorTraits::white())
+                    break;
+
+                augment(in_edge);
+                adopt();
+                if(get(m_tree_map, v) != tColorTraits::white() || !is_rooted(v) || label_of(v) != label)
+                    return;
+            }
+        }
+    }
+
+    /**
+     * augments the path through e, source(e, m_g) is in the source tree and
+     * target(e, m_g) in the sink tree. Tree edges which are saturated
+     * produce orphans.
+     */
+    void augment(edge_descriptor e)
+    {
+        BOOST_ASSERT(get(m_tree_map, source(e, m_g)) == tColorTraits::black());
+        BOOST_ASSERT(get(m_tree_map, target(e, m_g)) == tColorTraits::white());
+
+        tEdgeVal bottleneck = get(m_res_cap_map, e);
+        vertex_descriptor current_node = source(e, m_g);
+        while(current_node != m_source)
+        {
+            edge_descriptor pred = get_edge_to_parent(current_node);
+            bottleneck = (std::min)(bottleneck, get(m_res_cap_map, pred));
+            current_node = source(pred, m_g);
+        }
+        current_node = target(e, m_g);
+        while(current_node != m_sink)
+        {
+            edge_descriptor pred = get_edge_to_parent(current_node);
+            bottleneck = (std::min)(bottleneck, get(m_res_cap_map, pred));
+            current_node = target(pred, m_g);
+        }
+
+        std::size_t path_length = 1;
+        push_flow(e, bottleneck);
+        current_node = source(e, m_g);
+        while(current_node != m_source)
+        {
+            edge_descriptor pred = get_edge_to_parent(current_node);
+            push_flow(pred, bottleneck);
+            if(get(m_res_cap_map, pred) == 0)
+                make_orphan(current_node);
+            current_node = source(pred, m_g);
+            ++path_length;
+        }
+        current_node = target(e, m_g);
+        while(current_node != m_sink)
+        {
+            edge_descriptor pred = get_edge_to_parent(current_node);
+            push_flow(pred, bottleneck);
+            if(get(m_res_cap_map, pred) == 0)
+                make_orphan(current_node);
+            current_node = target(pred, m_g);
+            ++path_length;
+        }
+
+        m_flow += bottleneck;
+        m_counters.countAugmentation(path_length);
+    }
+
+    inline void push_flow(edge_descriptor e, tEdgeVal amount)
+    {
+        put(m_res_cap_map, e, get(m_res_cap_map, e) - amount);
+        BOOST_ASSERT(get(m_res_cap_map, e) >= 0);
+        const edge_descriptor rev = get(m_rev_edge_map, e);
+        put(m_res_cap_map, rev, get(m_res_cap_map, rev) + amount);
+    }
+
+    void adopt()
+    {
+        while(!m_ws.orphans.empty())
+        {
+            const vertex_descriptor v = m_ws.orphans.front();
+            m_ws.orphans.pop_front();
+            m_counters.countOrphan();
+
+            if(get(m_tree_map, v) == tColorTraits::black())
+                adopt_source_orphan(v);
+            else
+                adopt_sink_orphan(v);
+        }
+    }
+
+    void adopt_source_orphan(vertex_descriptor v)
+    {
+        const long label = label_of(v);
+        long min_label = (std::numeric_limits<long>::max)();
+        edge_descriptor new_parent_edge;
+
+        out_edge_iterator ei, e_end;
+        for(boost::tie(ei, e_end) = out_edges(v, m_g); ei != e_end; ++ei)
+        {
+            const edge_descriptor in_edge = get(m_rev_edge_map, *ei);
+            if(get(m_res_cap_map, in_edge) <= 0)
+                continue;
+            const vertex_descriptor other_node = source(in_edge, m_g);
+            if(get(m_tree_map, other_node) != tColorTraits::black() || !is_rooted(other_node))
+                continue;
+
+            const long other_label = label_of(other_node);
+            if(other_label == label - 1)
+            {
+                //same layer as before, the subtree stays valid
+                set_edge_to_parent(v, in_edge, label);
+                return;
+            }
+            if(other_label >= label && other_label < min_label && other_label <= m_source_height)
+            {
+                min_label = other_label;
+                new_parent_edge = in_edge;
+            }
+        }
+
+        orphan_children(v, true);
+        if(min_label != (std::numeric_limits<long>::max)())
+        {
+            set_edge_to_parent(v, new_parent_edge, min_label + 1);
+            push_to_layer(v);
+            return;
+        }
+
+        //drop v from the tree, its residual predecessors in the tree have to
+        //be scanned again to pick it up later
+        put(m_tree_map, v, tColorTraits::gray());
+        for(boost::tie(ei, e_end) = out_edges(v, m_g); ei != e_end; ++ei)
+        {
+            const edge_descriptor in_edge = get(m_rev_edge_map, *ei);
+            const vertex_descriptor other_node = source(in_edge, m_g);
+            if(get(m_tree_map, other_node) == tColorTraits::black() && get(m_res_cap_map, in_edge) > 0)
+                push_to_layer(other_node);
+        }
+    }
+
+    void adopt_sink_orphan(vertex_descriptor v)
+    {
+        BOOST_ASSERT(get(m_tree_map, v) == tColorTraits::white());
+        const long label = label_of(v);
+        long min_label = (std::numeric_limits<long>::max)();
+        edge_descriptor new_parent_edge;
+
+        out_edge_iterator ei, e_end;
+        for(boost::tie(ei, e_end) = out_edges(v, m_g); ei != e_end; ++ei)
+        {
+            const edge_descriptor out_edge = *ei;
+            if(get(m_res_cap_map, out_edge) <= 0)
+                continue;
+            const vertex_descriptor other_node = target(out_edge, m_g);
+            if(get(m_tree_map, other_node) != tColorTraits::white() || !is_rooted(other_node))
+                continue;
+
+            const long other_label = label_of(other_node);
+            if(other_label == label - 1)
+            {
+                set_edge_to_parent(v, out_edge, label);
+                return;
+            }
+            if(other_label >= label && other_label < min_label && other_label <= m_sink_height)
+            {
+                min_label = other_label;
+                new_parent_edge = out_edge;
+            }
+        }
+
+        orphan_children(v, false);
+        if(min_label != (std::numeric_limits<long>::max)())
+        {
+            set_edge_to_parent(v, new_parent_edge, min_label + 1);
+            push_to_layer(v);
+            return;
+        }
+
+        put(m_tree_map, v, tColorTraits::gray());
+        for(boost::tie(ei, e_end) = out_edges(v, m_g); ei != e_end; ++ei)
+        {
+            const edge_descriptor out_edge = *ei;
+            const vertex_descriptor other_node = target(out_edge, m_g);
+            if(get(m_tree_map, other_node) == tColorTraits::white() && get(m_res_cap_map, out_edge) > 0)
+                push_to_layer(other_node);
+        }
+    }
+
+    /**
+     * all children of v lose their parent, as the label of v changes
+     */
+    void orphan_children(vertex_descriptor v, bool source_tree)
+    {
+        const tColorValue tree = source_tree ? tColorTraits::black() : tColorTraits::white();
+        out_edge_iterator ei, e_end;
+        for(boost::tie(ei, e_end) = out_edges(v, m_g); ei != e_end; ++ei)
+        {
+            const vertex_descriptor other_node = target(*ei, m_g);
+            if(get(m_tree_map, other_node) != tree || !has_parent(other_node))
+                continue;
+
+            const edge_descriptor parent_edge = get_edge_to_parent(other_node);
+            const vertex_descriptor parent = source_tree ? source(parent_edge, m_g) : target(parent_edge, m_g);
+            if(parent == v)
+                make_orphan(other_node);
+        }
+    }
+
+    /**
+     * queues v for scanning in the current or next layer of its tree
+     */
+    void push_to_layer(vertex_descriptor v)
+    {
+        const bool source_tree = get(m_tree_map, v) == tColorTraits::black();
+        const long height = source_tree ? m_source_height : m_sink_height;
+        const bool is_next = label_of(v) > height;
+
+        unsigned char list_id;
+        std::vector<vertex_descriptor>* list;
+        if(source_tree)
+        {
+            list_id = is_next ? SOURCE_NEXT_LAYER : SOURCE_LAYER;
+            list = is_next ? &m_ws.source_next_layer : &m_ws.source_layer;
+        }
+        else
+        {
+            list_id = is_next ? SINK_NEXT_LAYER : SINK_LAYER;
+            list = is_next ? &m_ws.sink_next_layer : &m_ws.sink_layer;
+        }
+
+        if(list_id_of(v) == list_id)
+            return;
+        list_id_of(v) = list_id;
+        list->push_back(v);
+    }
+
+    inline void make_orphan(vertex_descriptor v)
+    {
+        m_ws.has_parent[get(m_index_map, v)] = false;
+        m_ws.orphans.push_back(v);
+    }
+
+    inline void set_edge_to_parent(vertex_descriptor v, edge_descriptor e, long label)
+    {
+        BOOST_ASSERT(get(m_res_cap_map, e) > 0);
+        const std::size_t i = get(m_index_map, v);
+        m_ws.predecessors[i] = e;
+        m_ws.has_parent[i] = true;
+        m_ws.labels[i] = label;
+    }
+
+    inline edge_descriptor get_edge_to_parent(vertex_descriptor v) const
+    {
+        return m_ws.predecessors[get(m_index_map, v)];
+    }
+
+    inline bool has_parent(vertex_descriptor v) const
+    {
+        return m_ws.has_parent[get(m_index_map, v)];
+    }
+
+    inline bool is_rooted(vertex_descriptor v) const
+    {
+        return v == m_source || v == m_sink || has_parent(v);
+    }
+
+    inline long label_of(vertex_descriptor v) const
+    {
+        return m_ws.labels[get(m_index_map, v)];
+    }
+
+    inline unsigned char& list_id_of(vertex_descriptor v)
+    {
+        return m_ws.list_ids[get(m_index_map, v)];
+    }
+
+    ////////
+    // member vars
+    ////////
+    Graph& m_g;
+    IndexMap m_index_map;
+    EdgeCapacityMap m_cap_map;
+    ResidualCapacityEdgeMap m_res_cap_map;
+    ReverseEdgeMap m_rev_edge_map;
+    ColorMap m_tree_map; //black: source tree, white: sink tree, gray: free
+    vertex_descriptor m_source;
+    vertex_descriptor m_sink;
+    ibfs_max_flow_workspace<Graph>& m_ws;
+    tEdgeVal m_flow;
+    long m_source_height; //label of the current layer of the source tree
+    long m_sink_height;
+    Counters& m_counters;
+};
+
+} //namespace detail
+
+/**
+ * Incremental breadth-first search max-flow with the same interface as
+ * bk_max_flow. After it returns the color map marks the vertices of the
+ * source tree black, which is not necessarily the minimal source side of
+ * the cut, as the algorithm can stop as soon as the sink tree is closed.
+ */
+template<class Graph,
+         class CapacityEdgeMap,
+         class ResidualCapacityEdgeMap,
+         class ReverseEdgeMap,
+         class ColorMap,
+         class IndexMap,
+         class Counters>
+typename boost::property_traits<CapacityEdgeMap>::value_type
+ibfs_max_flow(Graph& g,
+              CapacityEdgeMap cap,
+              ResidualCapacityEdgeMap res_cap,
+              ReverseEdgeMap rev,
+              ColorMap color,
+              IndexMap idx,
+              typename boost::graph_traits<Graph>::vertex_descriptor src,
+              typename boost::graph_traits<Graph>::vertex_descriptor sink,
+              ibfs_max_flow_workspace<Graph>& workspace,
+              Counters& counters)
+{
+    typedef typename boost::graph_traits<Graph>::vertex_descriptor vertex_descriptor;
+    typedef typename boost::graph_traits<Graph>::edge_descriptor edge_descriptor;
+
+    BOOST_CONCEPT_ASSERT(( boost::VertexListGraphConcept<Graph> ));
+    BOOST_CONCEPT_ASSERT(( boost::EdgeListGraphConcept<Graph> ));
+    BOOST_CONCEPT_ASSERT(( boost::IncidenceGraphConcept<Graph> ));
+    BOOST_CONCEPT_ASSERT(( boost::ReadablePropertyMapConcept<CapacityEdgeMap, edge_descriptor> ));
+    BOOST_CONCEPT_ASSERT(( boost::ReadWritePropertyMapConcept<ResidualCapacityEdgeMap, edge_descriptor> ));
+    BOOST_CONCEPT_ASSERT(( boost::ReadablePropertyMapConcept<ReverseEdgeMap, edge_descriptor> ));
+    BOOST_CONCEPT_ASSERT(( boost::ReadWritePropertyMapConcept<ColorMap, vertex_descriptor> ));
+    BOOST_CONCEPT_ASSERT(( boost::ReadablePropertyMapConcept<IndexMap, vertex_descriptor> ));
+    BOOST_ASSERT(num_vertices(g) >= 2 && src != sink);
+
+    detail::ibfs_max_flow<
+        Graph, CapacityEdgeMap, ResidualCapacityEdgeMap, ReverseEdgeMap,
+        ColorMap, IndexMap, Counters
+        > algo(g, cap, res_cap, rev, color, idx, src, sink, workspace, counters);
+
+    return algo.max_flow();
+}
+
+template<class Graph,
+         class CapacityEdgeMap,
+         class ResidualCapacityEdgeMap,
+         class ReverseEdgeMap,
+         class ColorMap,
+         class IndexMap>
+typename boost::property_traits<CapacityEdgeMap>::value_type
+ibfs_max_flow(Graph& g,
+              CapacityEdgeMap cap,
+              ResidualCapacityEdgeMap res_cap,
+              ReverseEdgeMap rev,
+              ColorMap color,
+              IndexMap idx,
+              typename boost::graph_traits<Graph>::vertex_descriptor src,
+              typename boost::graph_traits<Graph>::vertex_descriptor sink)
+{
+    ibfs_max_flow_workspace<Graph> workspace;
+    NoMaxFlowCounters counters;
+    return ibfs_max_flow(g, cap, res_cap, rev, color, idx, src, sink, workspace, counters);
+}
+
+#endif // IBFS_MAX_FLOW_H
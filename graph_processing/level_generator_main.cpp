@@ -1,11 +1,13 @@
 #include <algorithm>
 #include <iostream>
 #include <memory>
+#include <vector>
 
 #include <boost/program_options.hpp>
 #include <boost/numeric/ublas/vector.hpp>
 #include <boost/numeric/ublas/matrix.hpp>
 
+#include "../common/tuple_helper.h"
 #include "cmd_helpers.h"
 
 namespace bpo = boost::program_options;
@@ -31,7 +33,16 @@ namespace
             ("level-number", bpo::value<size_t>(),
                     "Number of linearly spaced leves between "
                     "min/max value of input vector")
+            ("adaptive", "Only emit the levels of the grid, which are "
+                    "close to a plateau of the denoised input vector")
+            ("level-tolerance", bpo::value<double>(),
+                    "Maximal distance between an adaptive level and a "
+                    "plateau value (default: the level distance)")
+            ("min-level-weight", bpo::value<size_t>()->default_value(1),
+                    "Minimal number of samples on plateaus within the "
+                    "tolerance of an adaptive level")
             ("debug,d", "Turn on debug output if flag is set");
+        cmd::addInputFormatOptions(desc);
 
         return desc;
     }
@@ -67,11 +78,19 @@ namespace
                 is_valid = false;
             }
 
+            if (! cmd::isValidInputFormat(vm))
+                is_valid = false;
+
             if (! vm.count("level-distance") && ! vm.count("level-number")) {
                 cout << "ERROR: either 'level-distance' or 'level-number' argument is required" << endl;
                 is_valid = false;
             }
 
+            if (vm.count("level-tolerance") && vm["level-tolerance"].as<double>() < 0.0) {
+                cout << "ERROR: 'level-tolerance' must not be negative" << endl;
+                is_valid = false;
+            }
+
             if (! vm.count("output")) {
                 cout << "ERROR: 'output' argument is required" << endl;
                 is_valid = false;
@@ -144,7 +163,72 @@ namespace
 
         populateLevels(levels, min, distance, n);
     }
-                                
+
+    /**
+     * Removes all levels from the grid, which are not supported by the
+     * plateaus of the denoised input: a level is kept if at least
+     * min_weight samples lie on plateaus within tolerance of it. If no
+     * level passes, the best supported one is kept, so the clustering is
+     * never handed an empty level file. The plateau values are sorted once and weighted by their length, so the
+     * support of each level is a difference of two prefix sums.
+     */
+    template <typename VectorType>
+    void filterLevelsByPlateauSupport(const bpo::variables_map &vm,
+                                      const VectorType &input,
+                                      VectorType &levels)
+    {
+        using namespace std;
+
+        VectorType data, weights;
+        helpers::postprocessTVDNData(input, data, weights);
+
+        vector<pair<double, double>> plateaus(data.size());
+        for (size_t i = 0; i < data.size(); i++)
+            plateaus[i] = make_pair(data(i), weights(i));
+        sort(plateaus.begin(), plateaus.end());
+
+        vector<double> values(plateaus.size());
+        vector<double> cumulated_weights(plateaus.size() + 1, 0.0);
+        for (size_t i = 0; i < plateaus.size(); i++) {
+            values[i] = plateaus[i].first;
+            cumulated_weights[i+1] = cumulated_weights[i] + plateaus[i].second;
+        }
+
+        double tolerance = levels.size() > 1 ? levels(1) - levels(0) : 0.0;
+        if (vm.count("level-tolerance"))
+            tolerance = vm["level-tolerance"].as<double>();
+        double min_weight = vm["min-level-weight"].as<size_t>();
+
+        size_t n = 0, best = 0;
+        double best_support = -1.0;
+        for (size_t i = 0; i < levels.size(); i++) {
+            auto lo = lower_bound(values.begin(), values.end(), levels(i) - tolerance);
+            auto hi = upper_bound(values.begin(), values.end(), levels(i) + tolerance);
+
+            double support = cumulated_weights[hi - values.begin()]
+                           - cumulated_weights[lo - values.begin()];
+            if (support > best_support) {
+                best = i;
+                best_support = support;
+            }
+            if (support >= min_weight && support > 0.0)
+                levels(n++) = levels(i);
+        }
+
+        if (n == 0 && levels.size() > 0) {
+            BOOST_LOG_TRIVIAL(warning) << "No level is supported by " << min_weight
+                                       << " samples within " << tolerance
+                                       << ", keeping the best supported level "
+                                       << levels(best) << " (" << best_support << " samples).";
+            levels(n++) = levels(best);
+        }
+
+        BOOST_LOG_TRIVIAL(debug) << "Kept " << n << " of " << levels.size()
+                                 << " levels supported by " << data.size()
+                                 << " plateaus.";
+
+        levels.resize(n, true);
+    }
 
     int runProgram(const bpo::variables_map &vm)
     {
@@ -162,6 +246,9 @@ namespace
         else
             populateLevelsByNumber(vm, input, levels);
 
+        if (vm.count("adaptive"))
+            filterLevelsByPlateauSupport(vm, input, levels);
+
         if (! cmd::saveOutputVector(vm, levels))
             return cmd::ERROR_UNHANDLED_EXCEPTION;
 
@@ -182,6 +269,7 @@ int main (const int argc, const char *argv[])
             return cmd::ERROR_IN_COMMAND_LINE;
         }
 
+        cmd::configureLogging(vm.count("debug"));
         return runProgram(vm);
     }
     catch (exception &e)
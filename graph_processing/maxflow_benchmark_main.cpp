@@ -0,0 +1,423 @@
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "cmd_helpers.h"
+#include "energy.h"
+#include "chain_energy.h"
+#include "maxflow_capture.h"
+
+namespace bpo = boost::program_options;
+
+namespace
+{
+    typedef EnergyGraph<long long> EnergyGraphType;
+    typedef ChainEnergy<long long> ChainEnergyType;
+
+    bpo::options_description initializeOptionsDescription()
+    {
+        using namespace std;
+
+        bpo::options_description desc("Options");
+        desc.add_options()
+            ("help,h", "Print help message")
+            ("input", bpo::value<vector<string>>()->composing(),
+                    "Filenames of DIMACS max-flow files or max-flow captures, "
+                    "written by graph_processing --dump-maxflow or "
+                    "--capture-maxflow")
+            ("maxflow", bpo::value<vector<string>>()->multitoken()
+                            ->default_value(vector<string>{ "chain", "bk", "ibfs", "pseudoflow" },
+                                            "chain bk ibfs pseudoflow"),
+                    "Solvers to compare: 'chain', 'bk', 'ibfs' and/or 'pseudoflow'")
+            ("repeat", bpo::value<int>()->default_value(1),
+                    "Number of times each instance is solved by each solver, "
+                    "the fastest run is reported")
+            ("debug,d", "Turn on debug output if flag is set");
+
+        return desc;
+    }
+
+    bool tryParseProgramOptions(const bpo::options_description &desc,
+                                const int argc,
+                                const char *argv[],
+                                bpo::variables_map &vm)
+    {
+        using namespace std;
+        using namespace boost::program_options;
+
+        bpo::positional_options_description ppos;
+        ppos.add("input", -1);
+
+        try {
+            bpo::store(bpo::command_line_parser(argc, argv)
+                        .options(desc)
+                        .positional(ppos)
+                        .run(), vm);
+            bpo::notify(vm);
+
+            if (cmd::isHelpRequest(desc, vm)) {
+                return cmd::SUCCESS;
+            }
+
+            bool is_valid = true;
+
+            if (! vm.count("input")) {
+                cout << "ERROR: 'input' argument is required" << endl;
+                is_valid = false;
+            }
+
+            for (auto& maxflow : vm["maxflow"].as<vector<string>>()) {
+                if (maxflow != "chain" && maxflow != "bk" && maxflow != "ibfs" && maxflow != "pseudoflow") {
+                    cout << "ERROR: unknown max-flow solver '" << maxflow << "'" << endl;
+                    is_valid = false;
+                }
+            }
+
+            if (vm["repeat"].as<int>() < 1) {
+                cout << "ERROR: 'repeat' must be positive" << endl;
+                is_valid = false;
+            }
+
+            return is_valid;
+        }
+        catch (error& e)
+        {
+            std::cerr << "ERROR: " << e.what() << std::endl << std::endl;
+            std::cerr << desc << std::endl;
+            return false;
+        }
+
+        return false;
+    }
+
+    EnergyGraphType::MaxFlowAlgorithm parseMaxFlowAlgorithm(const std::string &maxflow)
+    {
+        if (maxflow == "ibfs")
+            return EnergyGraphType::IBFS;
+        if (maxflow == "pseudoflow")
+            return EnergyGraphType::PSEUDOFLOW;
+
+        return EnergyGraphType::BOYKOV_KOLMOGOROV;
+    }
+
+    /**
+     * Reads a DIMACS max-flow file as written by EnergyGraph::dumpAsDimacs
+     * into a single instance. Source and sink arcs become source and sink
+     * capacities, the remaining arcs links between the variables, which
+     * are numbered in the order of their node ids.
+     */
+    bool loadDimacs(const std::string &filename,
+                    MaxFlowInstance &instance)
+    {
+        using namespace std;
+
+        instance.clear();
+
+        ifstream istream(filename);
+        if (! istream.good()) {
+            BOOST_LOG_TRIVIAL(error) << "Unable to open '" << filename << "'";
+            return false;
+        }
+
+        long n_nodes = 0;
+        long source_id = 0;
+        long sink_id = 0;
+        map<long, uint32_t> variable_by_id;
+
+        string line;
+        while (getline(istream, line))
+        {
+            if (line.empty())
+                continue;
+
+            istringstream tokens(line);
+            char kind;
+            tokens >> kind;
+
+            if (kind == 'c') {
+                string word;
+                long long energy_const;
+                if ((tokens >> word) && word == "energy" && (tokens >> word >> energy_const))
+                    instance.energy_const += energy_const;
+            }
+            else if (kind == 'p') {
+                string problem;
+                long n_arcs;
+                tokens >> problem >> n_nodes >> n_arcs;
+            }
+            else if (kind == 'n') {
+                long id;
+                char terminal;
+                tokens >> id >> terminal;
+                (terminal == 's' ? source_id : sink_id) = id;
+            }
+            else if (kind == 'a') {
+                if (variable_by_id.empty() && n_nodes > 0) {
+                    for (long id = 1; id <= n_nodes; id++) {
+                        if (id == source_id || id == sink_id)
+                            continue;
+
+                        variable_by_id[id] = instance.numVariables();
+                        instance.source_caps.push_back(0);
+                        instance.sink_caps.push_back(0);
+                    }
+                }
+
+                long from, to;
+                long long cap;
+                if (! (tokens >> from >> to >> cap) || from == to) {
+                    BOOST_LOG_TRIVIAL(error) << "Invalid arc '" << line << "' in '" << filename << "'";
+                    return false;
+                }
+
+                if (from == source_id && to != sink_id) {
+                    instance.source_caps[variable_by_id.at(to)] += cap;
+                }
+                else if (to == sink_id && from != source_id) {
+                    instance.sink_caps[variable_by_id.at(from)] += cap;
+                }
+                else if (from != sink_id && to != source_id && from != source_id) {
+                    MaxFlowInstance::Link link = { variable_by_id.at(from), variable_by_id.at(to), cap, 0 };
+                    instance.links.push_back(link);
+                }
+                else {
+                    BOOST_LOG_TRIVIAL(debug) << "Ignoring terminal arc '" << line << "'";
+                }
+            }
+        }
+
+        if (n_nodes == 0 || source_id == 0 || sink_id == 0) {
+            BOOST_LOG_TRIVIAL(error) << "'" << filename << "' is not a DIMACS max-flow file";
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * Adds the capacities of an instance to an empty energy.
+     * Source capacities are unary terms of the sink label, sink capacities
+     * of the source label and links pairwise terms.
+     */
+    template<typename Energy>
+    std::vector<typename Energy::VertexDescriptor> buildEnergy(const MaxFlowInstance &instance,
+                                                               Energy &energy)
+    {
+        std::vector<typename Energy::VertexDescriptor> variables;
+        for (std::size_t i = 0; i < instance.numVariables(); i++)
+            variables.push_back(energy.addVariable());
+
+        energy.addConstant(instance.energy_const);
+        for (std::size_t i = 0; i < instance.numVariables(); i++)
+            energy.addTerm1(variables[i], instance.sink_caps[i], instance.source_caps[i]);
+
+        for (auto& link : instance.links)
+            energy.addTerm2(variables[link.u], variables[link.v], 0, link.cap, link.rev_cap, 0);
+
+        return variables;
+    }
+
+    /**
+     * Solves the instance repeat times, stores the lowest run time in
+     * seconds and the cut in cut. Returns the minimum energy.
+     */
+    template<typename Energy>
+    long long solveInstance(const MaxFlowInstance &instance,
+                            Energy &energy,
+                            int repeat,
+                            double &seconds,
+                            std::vector<bool> &cut)
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        auto variables = buildEnergy(instance, energy);
+
+        seconds = std::numeric_limits<double>::max();
+        long long min_energy = 0;
+        for (int r = 0; r < repeat; r++)
+        {
+            auto start = Clock::now();
+            min_energy = energy.minimize();
+            auto end = Clock::now();
+
+            seconds = std::min(seconds, std::chrono::duration<double>(end - start).count());
+        }
+
+        cut.clear();
+        for (auto vertex_desc : variables)
+            cut.push_back(energy(vertex_desc).color == boost::black_color);
+
+        return min_energy;
+    }
+
+    /**
+     * Solves the instance with each solver that can handle it, adds the
+     * run times to seconds and counts the solved instances. The first
+     * solver's cut is the reference, returns false if another one differs.
+     */
+    bool compareSolvers(const MaxFlowInstance &instance,
+                        const std::string &filename,
+                        const std::vector<std::string> &solvers,
+                        int repeat,
+                        std::vector<double> &seconds,
+                        std::vector<std::size_t> &n_solved)
+    {
+        using namespace std;
+
+        bool has_reference = false;
+        bool is_consistent = true;
+        long long reference_energy = 0;
+        vector<bool> reference_cut;
+
+        for (size_t i = 0; i < solvers.size(); i++)
+        {
+            // The chain solver needs links between neighbours only, the
+            // max-flow solvers non-negative links
+            bool is_chain_solver = solvers[i] == "chain";
+            if (is_chain_solver ? ! instance.isChain() : ! instance.isSubmodular()) {
+                BOOST_LOG_TRIVIAL(debug) << "'" << solvers[i] << "' cannot solve expansion "
+                                         << instance.expansion << " of '" << filename << "'";
+                continue;
+            }
+
+            // A fresh energy per solver, so each one starts with cold
+            // caches and allocates its own workspace on the first run
+            double best_seconds = 0.0;
+            long long min_energy = 0;
+            vector<bool> cut;
+            if (is_chain_solver) {
+                unique_ptr<ChainEnergyType> energy(new ChainEnergyType());
+                min_energy = solveInstance(instance, *energy, repeat, best_seconds, cut);
+            }
+            else {
+                unique_ptr<EnergyGraphType> energy(new EnergyGraphType());
+                energy->setMaxFlowAlgorithm(parseMaxFlowAlgorithm(solvers[i]));
+                min_energy = solveInstance(instance, *energy, repeat, best_seconds, cut);
+            }
+
+            seconds[i] += best_seconds;
+            n_solved[i]++;
+
+            if (! has_reference) {
+                has_reference = true;
+                reference_energy = min_energy;
+                reference_cut.swap(cut);
+            }
+            else if (min_energy != reference_energy || cut != reference_cut) {
+                BOOST_LOG_TRIVIAL(error) << "'" << solvers[i] << "' disagrees on expansion "
+                                         << instance.expansion << " of '" << filename
+                                         << "': energy " << min_energy << " vs. " << reference_energy;
+                is_consistent = false;
+            }
+        }
+
+        return is_consistent;
+    }
+
+    int runProgram(const bpo::variables_map &vm)
+    {
+        using namespace std;
+
+        auto solvers = vm["maxflow"].as<vector<string>>();
+        auto repeat = vm["repeat"].as<int>();
+
+        vector<double> total_seconds(solvers.size(), 0.0);
+        vector<size_t> total_solved(solvers.size(), 0);
+        size_t n_mismatches = 0;
+
+        cout << left << setw(40) << "input" << right << setw(10) << "instances";
+        for (auto& solver : solvers)
+            cout << setw(12) << solver;
+        cout << endl;
+
+        for (auto& filename : vm["input"].as<vector<string>>())
+        {
+            vector<double> file_seconds(solvers.size(), 0.0);
+            size_t n_instances = 0;
+
+            // Captures are recognized by their tag, anything else is read
+            // as a single DIMACS instance
+            MaxFlowInstance instance;
+            MaxFlowCaptureReader reader;
+            if (reader.open(filename)) {
+                while (! reader.isAtEnd())
+                {
+                    if (! reader.read(instance)) {
+                        BOOST_LOG_TRIVIAL(error) << "Truncated instance after " << n_instances
+                                                 << " instances in '" << filename << "'";
+                        return cmd::ERROR_UNHANDLED_EXCEPTION;
+                    }
+                    n_instances++;
+
+                    if (! compareSolvers(instance, filename, solvers, repeat, file_seconds, total_solved))
+                        n_mismatches++;
+                }
+            }
+            else {
+                if (! loadDimacs(filename, instance))
+                    return cmd::ERROR_UNHANDLED_EXCEPTION;
+                n_instances++;
+
+                if (! compareSolvers(instance, filename, solvers, repeat, file_seconds, total_solved))
+                    n_mismatches++;
+            }
+
+            cout << left << setw(40) << filename << right << setw(10) << n_instances;
+            for (size_t i = 0; i < solvers.size(); i++) {
+                cout << setw(12) << fixed << setprecision(6) << file_seconds[i];
+                total_seconds[i] += file_seconds[i];
+            }
+            cout << endl;
+        }
+
+        cout << left << setw(50) << "total" << right;
+        for (auto seconds : total_seconds)
+            cout << setw(12) << fixed << setprecision(6) << seconds;
+        cout << endl;
+
+        cout << left << setw(50) << "solved" << right;
+        for (auto n_solved : total_solved)
+            cout << setw(12) << n_solved;
+        cout << endl;
+
+        if (n_mismatches > 0) {
+            BOOST_LOG_TRIVIAL(error) << n_mismatches << " instances with differing cuts";
+            return cmd::ERROR_UNHANDLED_EXCEPTION;
+        }
+
+        return cmd::SUCCESS;
+    }
+}
+
+int main (const int argc, const char *argv[])
+{
+    using namespace std;
+
+    auto desc = initializeOptionsDescription();
+
+    try
+    {
+        bpo::variables_map vm;
+        if (! tryParseProgramOptions(desc, argc, argv, vm)) {
+            return cmd::ERROR_IN_COMMAND_LINE;
+        }
+
+        cmd::configureLogging(vm.count("debug"));
+        return runProgram(vm);
+    }
+    catch (exception &e)
+    {
+        cerr << "Unhandled Exception reached the top of main: "
+             << e.what() << ", application will now exit" << endl;
+
+        return cmd::ERROR_UNHANDLED_EXCEPTION;
+    }
+}
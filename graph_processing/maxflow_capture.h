@@ -0,0 +1,263 @@
+#ifndef MAXFLOW_CAPTURE_H
+#define MAXFLOW_CAPTURE_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+/**
+ * Max-flow instance of a single expansion: the source and sink capacity
+ * of each variable, the capacities of each link between two variables in
+ * both directions and the energy constant. The minimum of the energy is
+ * the minimum cut plus the constant.
+ *
+ * Capacities are stored as 64 bit integers for every energy type, the
+ * costs are whole numbers anyway (see the README).
+ */
+struct MaxFlowInstance
+{
+    struct Link
+    {
+        std::uint32_t u;
+        std::uint32_t v;
+        std::int64_t cap;
+        std::int64_t rev_cap;
+    };
+
+    MaxFlowInstance()
+        : expansion(0)
+        , alpha_label(0)
+        , energy_const(0)
+    { }
+
+    void clear()
+    {
+        expansion = 0;
+        alpha_label = 0;
+        energy_const = 0;
+        source_caps.clear();
+        sink_caps.clear();
+        links.clear();
+    }
+
+    std::size_t numVariables() const
+    {
+        return source_caps.size();
+    }
+
+    /**
+     * Whether all links connect neighbouring variables, so that the chain
+     * solver can minimize the instance.
+     */
+    bool isChain() const
+    {
+        for (auto& link : links) {
+            if (std::abs(static_cast<long long>(link.u) - static_cast<long long>(link.v)) != 1)
+                return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * Whether every link has non-negative capacities. Only the chain
+     * solver keeps the negative links of non-submodular terms, the
+     * max-flow solvers cannot minimize them.
+     */
+    bool isSubmodular() const
+    {
+        for (auto& link : links) {
+            if (link.cap < 0 || link.rev_cap < 0)
+                return false;
+        }
+
+        return true;
+    }
+
+    std::int64_t expansion;
+    std::int32_t alpha_label;
+    std::int64_t energy_const;
+    std::vector<std::int64_t> source_caps;
+    std::vector<std::int64_t> sink_caps;
+    std::vector<Link> links;
+};
+
+/**
+ * Appends max-flow instances to a binary capture file. The file starts
+ * with the 8 byte tag "EBSMFC2", followed by the instances:
+ *
+ *   expansion, alpha_label, energy_const,
+ *   n_variables, n_variables x (source_cap, sink_cap),
+ *   n_links, n_links x (u - previous u, v - u, cap, rev_cap)
+ *
+ * Every number is a zigzag encoded variable length integer with 7 bits
+ * per byte, so the small capacities and the neighbouring links of an
+ * expansion graph take one or two bytes each. A capture of a whole run
+ * is a single file, several times smaller than a DIMACS file per
+ * expansion.
+ */
+class MaxFlowCaptureWriter
+{
+public:
+    bool open(const std::string& file_name)
+    {
+        m_ostream.open(file_name, std::ios::binary | std::ios::trunc);
+        m_ostream.write(tag(), tag_size);
+        return m_ostream.good();
+    }
+
+    bool isOpen() const
+    {
+        return m_ostream.is_open();
+    }
+
+    void write(const MaxFlowInstance& instance)
+    {
+        writeValue(instance.expansion);
+        writeValue(instance.alpha_label);
+        writeValue(instance.energy_const);
+
+        writeValue(instance.numVariables());
+        for (std::size_t i = 0; i < instance.numVariables(); i++) {
+            writeValue(instance.source_caps[i]);
+            writeValue(instance.sink_caps[i]);
+        }
+
+        writeValue(instance.links.size());
+        std::int64_t prev_u = 0;
+        for (auto& link : instance.links) {
+            writeValue(std::int64_t(link.u) - prev_u);
+            writeValue(std::int64_t(link.v) - std::int64_t(link.u));
+            writeValue(link.cap);
+            writeValue(link.rev_cap);
+            prev_u = link.u;
+        }
+    }
+
+    static const char* tag()
+    {
+        return "EBSMFC2";
+    }
+
+    static const std::size_t tag_size = 8;
+
+private:
+    void writeValue(std::int64_t value)
+    {
+        // zigzag: small negative numbers get small codes as well
+        std::uint64_t code = (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+        while (code >= 0x80) {
+            m_ostream.put(static_cast<char>((code & 0x7f) | 0x80));
+            code >>= 7;
+        }
+        m_ostream.put(static_cast<char>(code));
+    }
+
+    std::ofstream m_ostream;
+};
+
+/**
+ * Reads the instances of a capture file written by MaxFlowCaptureWriter
+ * one after another.
+ */
+class MaxFlowCaptureReader
+{
+public:
+    /**
+     * Returns false, if the file cannot be opened or is no capture file.
+     */
+    bool open(const std::string& file_name)
+    {
+        m_istream.open(file_name, std::ios::binary);
+
+        char tag[MaxFlowCaptureWriter::tag_size];
+        if (! m_istream.read(tag, sizeof(tag)))
+            return false;
+
+        return std::memcmp(tag, MaxFlowCaptureWriter::tag(), sizeof(tag)) == 0;
+    }
+
+    /**
+     * Reads the next instance. Returns false at the end of the file or if
+     * the instance is truncated or invalid.
+     */
+    bool read(MaxFlowInstance& instance)
+    {
+        instance.clear();
+
+        std::int64_t alpha_label = 0;
+        std::int64_t n_variables = 0;
+        if (! readValue(instance.expansion)
+            || ! readValue(alpha_label)
+            || ! readValue(instance.energy_const)
+            || ! readValue(n_variables)
+            || n_variables < 0 || n_variables > std::numeric_limits<std::uint32_t>::max())
+            return false;
+
+        instance.alpha_label = alpha_label;
+        instance.source_caps.resize(n_variables);
+        instance.sink_caps.resize(n_variables);
+        for (std::int64_t i = 0; i < n_variables; i++) {
+            if (! readValue(instance.source_caps[i]) || ! readValue(instance.sink_caps[i]))
+                return false;
+        }
+
+        std::int64_t n_links = 0;
+        if (! readValue(n_links) || n_links < 0)
+            return false;
+
+        std::int64_t u = 0;
+        std::int64_t v = 0;
+        for (std::int64_t i = 0; i < n_links; i++) {
+            std::int64_t u_delta, v_delta;
+            MaxFlowInstance::Link link;
+            if (! readValue(u_delta) || ! readValue(v_delta)
+                || ! readValue(link.cap) || ! readValue(link.rev_cap))
+                return false;
+
+            u += u_delta;
+            v = u + v_delta;
+            if (u < 0 || v < 0 || u >= n_variables || v >= n_variables || u == v)
+                return false;
+
+            link.u = u;
+            link.v = v;
+            instance.links.push_back(link);
+        }
+
+        return true;
+    }
+
+    bool isAtEnd()
+    {
+        return m_istream.peek() == std::char_traits<char>::eof();
+    }
+
+private:
+    bool readValue(std::int64_t& value)
+    {
+        std::uint64_t code = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            int byte = m_istream.get();
+            if (byte == std::char_traits<char>::eof())
+                return false;
+
+            code |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+            if (! (byte & 0x80)) {
+                value = static_cast<std::int64_t>(code >> 1) ^ -static_cast<std::int64_t>(code & 1);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    std::ifstream m_istream;
+};
+
+#endif // MAXFLOW_CAPTURE_H
@@ -0,0 +1,60 @@
+#ifndef MAXFLOW_COUNTERS_H
+#define MAXFLOW_COUNTERS_H
+
+#include <algorithm>
+#include <cstddef>
+
+/**
+ * Counter policy of bk_max_flow, which counts nothing. All members are
+ * empty inlines, so the counting compiles away.
+ */
+struct NoMaxFlowCounters
+{
+    inline void countEdgeScan()
+    { }
+
+    inline void countAugmentation(std::size_t)
+    { }
+
+    inline void countOrphan()
+    { }
+
+    inline void observeActiveNodes(std::size_t)
+    { }
+};
+
+/**
+ * Counter policy of bk_max_flow, which counts the work done in the grow,
+ * augment and adopt stages of the solver.
+ */
+struct MaxFlowCounters
+{
+    std::size_t edge_scans;       // residual edges inspected while growing the search trees
+    std::size_t augmentations;    // augmenting paths
+    std::size_t path_length;      // summed number of edges of all augmenting paths
+    std::size_t orphans;          // orphans processed in the adoption stage
+    std::size_t max_active_nodes; // high-water mark of the active queue
+
+    inline void countEdgeScan()
+    {
+        edge_scans++;
+    }
+
+    inline void countAugmentation(std::size_t length)
+    {
+        augmentations++;
+        path_length += length;
+    }
+
+    inline void countOrphan()
+    {
+        orphans++;
+    }
+
+    inline void observeActiveNodes(std::size_t active_nodes)
+    {
+        max_active_nodes = std::max(max_active_nodes, active_nodes);
+    }
+};
+
+#endif // MAXFLOW_COUNTERS_H
@@ -0,0 +1,680 @@
+#ifndef PSEUDOFLOW_MAX_FLOW_H
+#define PSEUDOFLOW_MAX_FLOW_H
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+#include <boost/assert.hpp>
+#include <boost/property_map/property_map.hpp>
+#include <boost/graph/graph_concepts.hpp>
+#include <boost/concept/assert.hpp>
+
+#include "maxflow_counters.h"
+
+/**
+ * Node and arc arrays of pseudoflow_max_flow, which can be kept alive
+ * between max-flow calls like bk_max_flow_workspace.
+ */
+template <class Graph, class ValueType>
+struct pseudoflow_max_flow_workspace
+{
+    typedef typename boost::graph_traits<Graph>::vertex_descriptor vertex_descriptor;
+    typedef typename boost::graph_traits<Graph>::edge_descriptor edge_descriptor;
+
+    struct Arc
+    {
+        int from;
+        int to;
+        ValueType capacity;
+        ValueType flow;
+        bool upward; //true if from is the child, if the arc is in a tree
+        edge_descriptor edge;
+    };
+
+    void reset(std::size_t n_verts)
+    {
+        arcs.clear();
+        vertices.resize(n_verts);
+        labels.assign(n_verts, 0);
+        excess.assign(n_verts, 0);
+        parent.assign(n_verts, -1);
+        arc_to_parent.assign(n_verts, -1);
+        child_list.assign(n_verts, -1);
+        next.assign(n_verts, -1);
+        next_scan.assign(n_verts, -1);
+        next_arc.assign(n_verts, 0);
+        out_of_tree_begin.assign(n_verts + 1, 0);
+        out_of_tree_size.assign(n_verts, 0);
+        label_count.assign(n_verts + 1, 0);
+        bucket_start.assign(n_verts + 1, -1);
+        bucket_end.assign(n_verts + 1, -1);
+        distances.assign(n_verts, 0);
+        queue.clear();
+    }
+
+    std::vector<Arc> arcs;
+    std::vector<vertex_descriptor> vertices;
+    std::vector<long> labels;
+    std::vector<ValueType> excess;
+    std::vector<int> parent;
+    std::vector<int> arc_to_parent;
+    std::vector<int> child_list;
+    std::vector<int> next;         //next sibling, or next root of a bucket
+    std::vector<int> next_scan;
+    std::vector<int> next_arc;
+    std::vector<int> out_of_tree;  //arcs a node can push along, grouped by node
+    std::vector<int> out_of_tree_begin;
+    std::vector<int> out_of_tree_size;
+    std::vector<int> label_count;
+    std::vector<int> bucket_start; //strong roots by label
+    std::vector<int> bucket_end;
+    std::vector<long> distances;   //flow recovery
+    std::vector<int> queue;
+};
+
+namespace detail
+{
+
+using namespace boost;
+
+/**
+ * Highest label pseudoflow algorithm of D. S. Hochbaum, "The pseudoflow
+ * algorithm: A new algorithm for the maximum-flow problem" (2008), following
+ * the reference implementation of B. G. Chandran and D. S. Hochbaum.
+ *
+ * All source and sink arcs are saturated up front, which gives every node
+ * an excess (strong) or a deficit (weak). The nodes form a forest of
+ * normalized trees, in which only roots carry excess. The strong root with
+ * the highest label looks for an arc from its tree to a weak node one label
+ * below; the trees are merged along it and the excess is pushed towards the
+ * weak root, splitting the tree at saturated arcs. Trees without such arc
+ * are relabeled, trees above a label gap are lifted out. Afterwards the
+ * strong nodes form a minimum cut, the excess is returned to the source to
+ * obtain a maximum flow and its residual capacities.
+ */
+template <class Graph,
+         class EdgeCapacityMap,
+         class ResidualCapacityEdgeMap,
+         class ReverseEdgeMap,
+         class IndexMap,
+         class Counters = NoMaxFlowCounters>
+class pseudoflow_max_flow
+{
+    typedef typename property_traits<EdgeCapacityMap>::value_type tEdgeVal;
+    typedef graph_traits<Graph> tGraphTraits;
+    typedef typename tGraphTraits::vertex_iterator vertex_iterator;
+    typedef typename tGraphTraits::vertex_descriptor vertex_descriptor;
+    typedef typename tGraphTraits::edge_descriptor edge_descriptor;
+    typedef typename tGraphTraits::edge_iterator edge_iterator;
+    typedef typename tGraphTraits::out_edge_iterator out_edge_iterator;
+    typedef pseudoflow_max_flow_workspace<Graph, tEdgeVal> tWorkspace;
+    typedef typename tWorkspace::Arc tArc;
+
+public:
+    pseudoflow_max_flow(Graph& g,
+                        EdgeCapacityMap cap,
+                        ResidualCapacityEdgeMap res,
+                        ReverseEdgeMap rev,
+                        IndexMap idx,
+                        vertex_descriptor src,
+                        vertex_descriptor sink,
+                        tWorkspace& workspace,
+                        Counters& counters):
+        m_g(g),
+        m_index_map(idx),
+        m_cap_map(cap),
+        m_res_cap_map(res),
+        m_rev_edge_map(rev),
+        m_source(src),
+        m_sink(sink),
+        m_ws((workspace.reset(num_vertices(g)), workspace)),
+        m_num_nodes(num_vertices(g)),
+        m_highest_strong_label(1),
+        m_counters(counters)
+    { }
+
+    tEdgeVal max_flow()
+    {
+        initialize();
+        while(true)
+        {
+            const int strong_root = highest_strong_root();
+            if(strong_root < 0)
+                break;
+            process_root(strong_root);
+        }
+        recover_flow();
+
+        tEdgeVal flow = 0;
+        out_edge_iterator ei, e_end;
+        for(boost::tie(ei, e_end) = out_edges(m_sink, m_g); ei != e_end; ++ei)
+        {
+            flow += get(m_res_cap_map, *ei) - get(m_cap_map, *ei);
+        }
+        return flow;
+    }
+
+protected:
+    /**
+     * saturates all source and sink arcs and collects the arcs between the
+     * other nodes. Every node starts as a single node tree.
+     */
+    void initialize()
+    {
+        vertex_iterator vi, v_end;
+        for(boost::tie(vi, v_end) = vertices(m_g); vi != v_end; ++vi)
+        {
+            m_ws.vertices[get(m_index_map, *vi)] = *vi;
+        }
+
+        edge_iterator ei, e_end;
+        for(boost::tie(ei, e_end) = edges(m_g); ei != e_end; ++ei)
+        {
+            put(m_res_cap_map, *ei, get(m_cap_map, *ei));
+        }
+
+        const int source_index = get(m_index_map, m_source);
+        const int sink_index = get(m_index_map, m_sink);
+        for(boost::tie(ei, e_end) = edges(m_g); ei != e_end; ++ei)
+        {
+            const edge_descriptor e = *ei;
+            const tEdgeVal capacity = get(m_cap_map, e);
+            if(capacity <= 0)
+                continue;
+
+            const int from = get(m_index_map, source(e, m_g));
+            const int to = get(m_index_map, target(e, m_g));
+            if(from == sink_index || to == source_index)
+                continue; //never part of a source-sink path
+            if(from == source_index || to == sink_index)
+            {
+                push_on_edge(e, capacity);
+                if(from != source_index)
+                    m_ws.excess[from] -= capacity;
+                if(to != sink_index)
+                    m_ws.excess[to] += capacity;
+                continue;
+            }
+
+            tArc arc;
+            arc.from = from;
+            arc.to = to;
+            arc.capacity = capacity;
+            arc.flow = 0;
+            arc.upward = true;
+            arc.edge = e;
+            m_ws.arcs.push_back(arc);
+            m_ws.out_of_tree_begin[from]++;
+            m_ws.out_of_tree_begin[to]++;
+        }
+
+        //each node has room for all its arcs, an arc is only in the list
+        //of the node which can push along it
+        int offset = 0;
+        for(std::size_t i = 0; i < m_num_nodes; ++i)
+        {
+            const int n_arcs = m_ws.out_of_tree_begin[i];
+            m_ws.out_of_tree_begin[i] = offset;
+            offset += n_arcs;
+        }
+        m_ws.out_of_tree_begin[m_num_nodes] = offset;
+        m_ws.out_of_tree.resize(offset);
+        for(std::size_t a = 0; a < m_ws.arcs.size(); ++a)
+        {
+            add_out_of_tree_arc(m_ws.arcs[a].from, a);
+        }
+
+        for(std::size_t i = 0; i < m_num_nodes; ++i)
+        {
+            if(static_cast<int>(i) == source_index || static_cast<int>(i) == sink_index)
+                continue;
+            if(m_ws.excess[i] > 0)
+            {
+                m_ws.labels[i] = 1;
+                m_ws.label_count[1]++;
+                add_to_strong_bucket(i);
+            }
+            else
+            {
+                m_ws.label_count[0]++;
+            }
+        }
+    }
+
+    int highest_strong_root()
+    {
+        for(long i = m_highest_strong_label; i > 0; --i)
+        {
+            if(m_ws.bucket_start[i] < 0)
+                continue;
+
+            m_highest_strong_label = i;
+            if(m_ws.label_count[i - 1] > 0)
+                return pop_strong_bucket(i);
+
+            //gap, the trees can't reach a weak node anymore
+            while(m_ws.bucket_start[i] >= 0)
+            {
+                lift_all(pop_strong_bucket(i));
+            }
+        }
+
+        if(m_ws.bucket_start[0] < 0)
+            return -1;
+
+        while(m_ws.bucket_start[0] >= 0)
+        {
+            const int root = pop_strong_bucket(0);
+            m_ws.labels[root] = 1;
+            m_ws.label_count[0]--;
+            m_ws.label_count[1]++;
+            add_to_strong_bucket(root);
+        }
+        m_highest_strong_label = 1;
+        return pop_strong_bucket(1);
+    }
+
+    void lift_all(int root)
+    {
+        int current = root;
+        m_ws.next_scan[current] = m_ws.child_list[current];
+        m_ws.label_count[m_ws.labels[current]]--;
+        m_ws.labels[current] = m_num_nodes;
+
+        for(; current >= 0; current = m_ws.parent[current])
+        {
+            while(m_ws.next_scan[current] >= 0)
+            {
+                const int child = m_ws.next_scan[current];
+                m_ws.next_scan[current] = m_ws.next[child];
+                current = child;
+                m_ws.next_scan[current] = m_ws.child_list[current];
+                m_ws.label_count[m_ws.labels[current]]--;
+                m_ws.labels[current] = m_num_nodes;
+            }
+        }
+    }
+
+    /**
+     * searches the nodes of the tree with the label of the root for a
+     * merger arc, depth first. Nodes without one are relabeled.
+     */
+    void process_root(int strong_root)
+    {
+        int strong_node = strong_root;
+        int weak_node;
+        int arc;
+
+        m_ws.next_scan[strong_root] = m_ws.child_list[strong_root];
+        if((arc = find_weak_node(strong_root, weak_node)) >= 0)
+        {
+            merge(weak_node, strong_node, arc);
+            push_excess(strong_root);
+            return;
+        }
+        check_children(strong_root);
+
+        while(strong_node >= 0)
+        {
+            while(m_ws.next_scan[strong_node] >= 0)
+            {
+                const int child = m_ws.next_scan[strong_node];
+                m_ws.next_scan[strong_node] = m_ws.next[child];
+                strong_node = child;
+                m_ws.next_scan[strong_node] = m_ws.child_list[strong_node];
+
+                if((arc = find_weak_node(strong_node, weak_node)) >= 0)
+                {
+                    merge(weak_node, strong_node, arc);
+                    push_excess(strong_root);
+                    return;
+                }
+                check_children(strong_node);
+            }
+            if((strong_node = m_ws.parent[strong_node]) >= 0)
+                check_children(strong_node);
+        }
+
+        add_to_strong_bucket(strong_root);
+        ++m_highest_strong_label;
+    }
+
+    int find_weak_node(int strong_node, int& weak_node)
+    {
+        const int begin = m_ws.out_of_tree_begin[strong_node];
+        int& size = m_ws.out_of_tree_size[strong_node];
+        for(int i = m_ws.next_arc[strong_node]; i < size; ++i)
+        {
+            m_counters.countEdgeScan();
+            const int arc = m_ws.out_of_tree[begin + i];
+            const tArc& a = m_ws.arcs[arc];
+            const int other = a.from == strong_node ? a.to : a.from;
+            if(m_ws.labels[other] == m_highest_strong_label - 1)
+            {
+                m_ws.next_arc[strong_node] = i;
+                weak_node = other;
+                m_ws.arcs[arc].upward = (a.from == strong_node);
+                --size;
+                m_ws.out_of_tree[begin + i] = m_ws.out_of_tree[begin + size];
+                return arc;
+            }
+        }
+        m_ws.next_arc[strong_node] = size;
+        return -1;
+    }
+
+    void check_children(int node)
+    {
+        for(; m_ws.next_scan[node] >= 0; m_ws.next_scan[node] = m_ws.next[m_ws.next_scan[node]])
+        {
+            if(m_ws.labels[m_ws.next_scan[node]] == m_ws.labels[node])
+                return;
+        }
+        m_ws.label_count[m_ws.labels[node]]--;
+        m_ws.labels[node]++;
+        m_ws.label_count[m_ws.labels[node]]++;
+        m_ws.next_arc[node] = 0;
+    }
+
+    /**
+     * hangs the tree of child below parent (a weak node) along new_arc,
+     * child becomes the root of its tree first
+     */
+    void merge(int parent, int child, int new_arc)
+    {
+        int current = child;
+        int new_parent = parent;
+        while(m_ws.parent[current] >= 0)
+        {
+            const int old_arc = m_ws.arc_to_parent[current];
+            m_ws.arc_to_parent[current] = new_arc;
+            const int old_parent = m_ws.parent[current];
+            break_relationship(old_parent, current);
+            add_relationship(new_parent, current);
+            new_parent = current;
+            current = old_parent;
+            new_arc = old_arc;
+            m_ws.arcs[new_arc].upward = !m_ws.arcs[new_arc].upward;
+        }
+        m_ws.arc_to_parent[current] = new_arc;
+        add_relationship(new_parent, current);
+    }
+
+    /**
+     * pushes the excess of the former strong root towards the new root,
+     * saturated arcs split the tree
+     */
+    void push_excess(int strong_root)
+    {
+        tEdgeVal parent_excess = 1;
+        std::size_t path_length = 0;
+        int current = strong_root;
+        int parent;
+        for(; m_ws.excess[current] != 0 && m_ws.parent[current] >= 0; current = parent)
+        {
+            parent = m_ws.parent[current];
+            parent_excess = m_ws.excess[parent];
+            tArc& arc = m_ws.arcs[m_ws.arc_to_parent[current]];
+            const tEdgeVal residual = arc.upward ? arc.capacity - arc.flow : arc.flow;
+            const tEdgeVal amount = (std::min)(residual, m_ws.excess[current]);
+
+            arc.flow += arc.upward ? amount : -amount;
+            m_ws.excess[parent] += amount;
+            m_ws.excess[current] -= amount;
+            ++path_length;
+
+            if(m_ws.excess[current] > 0)
+            {
+                //the arc is saturated, the parent can push back along it
+                arc.upward = !arc.upward;
+                add_out_of_tree_arc(parent, m_ws.arc_to_parent[current]);
+                break_relationship(parent, current);
+                add_to_strong_bucket(current);
+                m_counters.countOrphan();
+            }
+        }
+        if(m_ws.excess[current] > 0 && parent_excess <= 0)
+            add_to_strong_bucket(current);
+
+        m_counters.countAugmentation(path_length);
+    }
+
+    /**
+     * returns the excess of the strong nodes to the source by push-relabel
+     * on the residual graph. Weak nodes give their deficit back to the
+     * sink. All arcs from strong to weak nodes are saturated, so the flow
+     * across the cut does not change.
+     */
+    void recover_flow()
+    {
+        for(std::size_t a = 0; a < m_ws.arcs.size(); ++a)
+        {
+            const tArc& arc = m_ws.arcs[a];
+            if(arc.flow != 0)
+                push_on_edge(arc.edge, arc.flow);
+        }
+
+        const int source_index = get(m_index_map, m_source);
+        const int sink_index = get(m_index_map, m_sink);
+        for(std::size_t i = 0; i < m_num_nodes; ++i)
+        {
+            if(m_ws.excess[i] >= 0 || static_cast<int>(i) == source_index || static_cast<int>(i) == sink_index)
+                continue;
+
+            edge_descriptor to_sink;
+            bool is_there;
+            boost::tie(to_sink, is_there) = edge(m_ws.vertices[i], m_sink, m_g);
+            BOOST_ASSERT(is_there);
+            push_on_edge(to_sink, m_ws.excess[i]);
+            m_ws.excess[i] = 0;
+        }
+
+        //distances to the source in the residual graph
+        const long infinity = (std::numeric_limits<long>::max)() / 2;
+        std::fill(m_ws.distances.begin(), m_ws.distances.end(), infinity);
+        m_ws.distances[source_index] = 0;
+        m_ws.queue.clear();
+        m_ws.queue.push_back(source_index);
+        for(std::size_t q = 0; q < m_ws.queue.size(); ++q)
+        {
+            const int current = m_ws.queue[q];
+            out_edge_iterator ei, e_end;
+            for(boost::tie(ei, e_end) = out_edges(m_ws.vertices[current], m_g); ei != e_end; ++ei)
+            {
+                const int other = get(m_index_map, target(*ei, m_g));
+                if(other == sink_index || m_ws.distances[other] != infinity)
+                    continue;
+                if(get(m_res_cap_map, get(m_rev_edge_map, *ei)) > 0)
+                {
+                    m_ws.distances[other] = m_ws.distances[current] + 1;
+                    m_ws.queue.push_back(other);
+                }
+            }
+        }
+
+        m_ws.queue.clear();
+        for(std::size_t i = 0; i < m_num_nodes; ++i)
+        {
+            if(m_ws.excess[i] > 0 && static_cast<int>(i) != source_index && static_cast<int>(i) != sink_index)
+                m_ws.queue.push_back(i);
+        }
+        for(std::size_t q = 0; q < m_ws.queue.size(); ++q)
+        {
+            discharge(m_ws.queue[q], source_index, sink_index);
+        }
+    }
+
+    void discharge(int node, int source_index, int sink_index)
+    {
+        while(m_ws.excess[node] > 0)
+        {
+            long min_distance = (std::numeric_limits<long>::max)();
+            out_edge_iterator ei, e_end;
+            for(boost::tie(ei, e_end) = out_edges(m_ws.vertices[node], m_g); ei != e_end && m_ws.excess[node] > 0; ++ei)
+            {
+                const edge_descriptor e = *ei;
+                const int other = get(m_index_map, target(e, m_g));
+                const tEdgeVal residual = get(m_res_cap_map, e);
+                if(other == sink_index || residual <= 0)
+                    continue;
+
+                if(m_ws.distances[node] == m_ws.distances[other] + 1)
+                {
+                    const tEdgeVal amount = (std::min)(residual, m_ws.excess[node]);
+                    push_on_edge(e, amount);
+                    m_ws.excess[node] -= amount;
+                    if(other != source_index)
+                    {
+                        if(m_ws.excess[other] == 0)
+                            m_ws.queue.push_back(other);
+                        m_ws.excess[other] += amount;
+                    }
+                }
+                else
+                {
+                    min_distance = (std::min)(min_distance, m_ws.distances[other]);
+                }
+            }
+            if(m_ws.excess[node] > 0)
+            {
+                BOOST_ASSERT(min_distance != (std::numeric_limits<long>::max)());
+                m_ws.distances[node] = min_distance + 1;
+            }
+        }
+    }
+
+    inline void push_on_edge(edge_descriptor e, tEdgeVal amount)
+    {
+        put(m_res_cap_map, e, get(m_res_cap_map, e) - amount);
+        const edge_descriptor rev = get(m_rev_edge_map, e);
+        put(m_res_cap_map, rev, get(m_res_cap_map, rev) + amount);
+    }
+
+    inline void add_out_of_tree_arc(int node, int arc)
+    {
+        m_ws.out_of_tree[m_ws.out_of_tree_begin[node] + m_ws.out_of_tree_size[node]] = arc;
+        m_ws.out_of_tree_size[node]++;
+    }
+
+    inline void add_to_strong_bucket(int root)
+    {
+        const long label = m_ws.labels[root];
+        m_ws.next[root] = -1;
+        if(m_ws.bucket_start[label] >= 0)
+            m_ws.next[m_ws.bucket_end[label]] = root;
+        else
+            m_ws.bucket_start[label] = root;
+        m_ws.bucket_end[label] = root;
+    }
+
+    inline int pop_strong_bucket(long label)
+    {
+        const int root = m_ws.bucket_start[label];
+        m_ws.bucket_start[label] = m_ws.next[root];
+        m_ws.next[root] = -1;
+        return root;
+    }
+
+    inline void add_relationship(int new_parent, int child)
+    {
+        m_ws.parent[child] = new_parent;
+        m_ws.next[child] = m_ws.child_list[new_parent];
+        m_ws.child_list[new_parent] = child;
+    }
+
+    inline void break_relationship(int old_parent, int child)
+    {
+        m_ws.parent[child] = -1;
+        if(m_ws.child_list[old_parent] == child)
+        {
+            m_ws.child_list[old_parent] = m_ws.next[child];
+            m_ws.next[child] = -1;
+            return;
+        }
+
+        int current = m_ws.child_list[old_parent];
+        while(m_ws.next[current] != child)
+            current = m_ws.next[current];
+        m_ws.next[current] = m_ws.next[child];
+        m_ws.next[child] = -1;
+    }
+
+    ////////
+    // member vars
+    ////////
+    Graph& m_g;
+    IndexMap m_index_map;
+    EdgeCapacityMap m_cap_map;
+    ResidualCapacityEdgeMap m_res_cap_map;
+    ReverseEdgeMap m_rev_edge_map;
+    vertex_descriptor m_source;
+    vertex_descriptor m_sink;
+    tWorkspace& m_ws;
+    std::size_t m_num_nodes;
+    long m_highest_strong_label;
+    Counters& m_counters;
+};
+
+} //namespace detail
+
+/**
+ * Pseudoflow max-flow with the same interface as bk_max_flow, except that
+ * no color map is written. Afterwards the residual capacities are the ones
+ * of a maximum flow.
+ */
+template<class Graph,
+         class CapacityEdgeMap,
+         class ResidualCapacityEdgeMap,
+         class ReverseEdgeMap,
+         class IndexMap,
+         class Counters>
+typename boost::property_traits<CapacityEdgeMap>::value_type
+pseudoflow_max_flow(Graph& g,
+                    CapacityEdgeMap cap,
+                    ResidualCapacityEdgeMap res_cap,
+                    ReverseEdgeMap rev,
+                    IndexMap idx,
+                    typename boost::graph_traits<Graph>::vertex_descriptor src,
+                    typename boost::graph_traits<Graph>::vertex_descriptor sink,
+                    pseudoflow_max_flow_workspace<Graph, typename boost::property_traits<CapacityEdgeMap>::value_type>& workspace,
+                    Counters& counters)
+{
+    typedef typename boost::graph_traits<Graph>::edge_descriptor edge_descriptor;
+
+    BOOST_CONCEPT_ASSERT(( boost::VertexListGraphConcept<Graph> ));
+    BOOST_CONCEPT_ASSERT(( boost::EdgeListGraphConcept<Graph> ));
+    BOOST_CONCEPT_ASSERT(( boost::IncidenceGraphConcept<Graph> ));
+    BOOST_CONCEPT_ASSERT(( boost::ReadablePropertyMapConcept<CapacityEdgeMap, edge_descriptor> ));
+    BOOST_CONCEPT_ASSERT(( boost::ReadWritePropertyMapConcept<ResidualCapacityEdgeMap, edge_descriptor> ));
+    BOOST_CONCEPT_ASSERT(( boost::ReadablePropertyMapConcept<ReverseEdgeMap, edge_descriptor> ));
+    BOOST_ASSERT(num_vertices(g) >= 2 && src != sink);
+
+    detail::pseudoflow_max_flow<
+        Graph, CapacityEdgeMap, ResidualCapacityEdgeMap, ReverseEdgeMap,
+        IndexMap, Counters
+        > algo(g, cap, res_cap, rev, idx, src, sink, workspace, counters);
+
+    return algo.max_flow();
+}
+
+template<class Graph,
+         class CapacityEdgeMap,
+         class ResidualCapacityEdgeMap,
+         class ReverseEdgeMap,
+         class IndexMap>
+typename boost::property_traits<CapacityEdgeMap>::value_type
+pseudoflow_max_flow(Graph& g,
+                    CapacityEdgeMap cap,
+                    ResidualCapacityEdgeMap res_cap,
+                    ReverseEdgeMap rev,
+                    IndexMap idx,
+                    typename boost::graph_traits<Graph>::vertex_descriptor src,
+                    typename boost::graph_traits<Graph>::vertex_descriptor sink)
+{
+    pseudoflow_max_flow_workspace<Graph, typename boost::property_traits<CapacityEdgeMap>::value_type> workspace;
+    NoMaxFlowCounters counters;
+    return pseudoflow_max_flow(g, cap, res_cap, rev, idx, src, sink, workspace, counters);
+}
+
+#endif // PSEUDOFLOW_MAX_FLOW_H
@@ -1,9 +1,18 @@
 #ifndef RUNTIME_STATISTICS_H
 #define RUNTIME_STATISTICS_H
 
+#include <chrono>
 #include <map>
+#include <string>
+#include <utility>
 #include <vector>
 
+#include "maxflow_counters.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
 template<typename EnergyLabel = std::string,
          typename EnergyType = long long>
 class RuntimeStatistics
@@ -31,6 +40,16 @@ public:
         return m_energy_history.find(label)->second;
     }
 
+    const EnergyHistoryType& energyHistory() const
+    {
+        return m_energy_history;
+    }
+
+    void setEnergyHistory(const EnergyHistoryType& energy_history)
+    {
+        m_energy_history = energy_history;
+    }
+
 private:
     EnergyHistoryType m_energy_history;
 
@@ -50,5 +69,149 @@ private:
     }
 };
 
+/**
+ * Measurements of a single expansion (or fusion) move. A skipped move has
+ * no max-flow, its build time is the time of the gain bound.
+ */
+template<typename EnergyType = long long>
+struct ExpansionRecord
+{
+    enum Outcome { EXECUTED, SKIPPED_BY_BOUND, SKIPPED_UNCHANGED };
+
+    ExpansionRecord(int iteration = -1, int label = -1)
+        : iteration(iteration)
+        , label(label)
+        , build_seconds(0.0)
+        , maxflow_seconds(0.0)
+        , sites_changed(0)
+        , energy_delta(0)
+        , maxflow()
+        , outcome(EXECUTED)
+    { }
+
+    int iteration;
+    int label;
+    double build_seconds;
+    double maxflow_seconds;
+    std::size_t sites_changed;
+    EnergyType energy_delta;
+    MaxFlowCounters maxflow;
+    Outcome outcome;
+};
+
+/**
+ * Statistics policy of BinaryOptimization, which records nothing. All
+ * members are empty inlines, so the instrumentation compiles away.
+ */
+struct NoExpansionStatistics
+{
+    typedef int TimePoint;
+    typedef NoMaxFlowCounters MaxFlowCountersType;
+
+    static inline TimePoint now()
+    {
+        return 0;
+    }
+
+    static inline double secondsBetween(TimePoint, TimePoint)
+    {
+        return 0.0;
+    }
+
+    template<typename RecordType>
+    static inline void recordMaxFlowCounters(RecordType&, const MaxFlowCountersType&)
+    { }
+
+    template<typename RecordType>
+    inline void record(const RecordType&)
+    { }
+};
+
+/**
+ * Statistics policy of BinaryOptimization, which keeps a record of every
+ * expansion move.
+ */
+template<typename EnergyType = long long>
+class ExpansionStatistics
+{
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+    typedef ExpansionRecord<EnergyType> RecordType;
+    typedef MaxFlowCounters MaxFlowCountersType;
+
+    static inline TimePoint now()
+    {
+        return std::chrono::steady_clock::now();
+    }
+
+    static inline double secondsBetween(TimePoint start, TimePoint end)
+    {
+        return std::chrono::duration<double>(end - start).count();
+    }
+
+    static inline void recordMaxFlowCounters(RecordType& expansion_record,
+                                             const MaxFlowCountersType& counters)
+    {
+        expansion_record.maxflow = counters;
+    }
+
+    inline void record(const RecordType& expansion_record)
+    {
+        m_records.push_back(expansion_record);
+    }
+
+    const std::vector<RecordType>& records() const
+    {
+        return m_records;
+    }
+
+private:
+    std::vector<RecordType> m_records;
+};
+
+/**
+ * Wall clock time of the named processing stages of a program run.
+ */
+class StageTimes
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    void start()
+    {
+        m_stage_start = Clock::now();
+    }
+
+    void stop(const std::string& stage)
+    {
+        auto seconds = std::chrono::duration<double>(Clock::now() - m_stage_start).count();
+        m_stages.push_back(std::make_pair(stage, seconds));
+    }
+
+    const std::vector<std::pair<std::string, double>>& stages() const
+    {
+        return m_stages;
+    }
+
+private:
+    Clock::time_point m_stage_start;
+    std::vector<std::pair<std::string, double>> m_stages;
+};
+
+/**
+ * Peak resident set size of the process in kilobytes, 0 if unknown.
+ */
+inline long peakResidentSetSize()
+{
+#if defined(__APPLE__)
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss / 1024 : 0;
+#elif defined(__unix__)
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+#else
+    return 0;
+#endif
+}
 
 #endif // RUNTIME_STATISTICS_H
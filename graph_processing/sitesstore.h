@@ -23,9 +23,11 @@ class SitesStore
 	{
         VertexDescriptor m_vertex;
         LabelType m_label;
-        bool m_is_active;
-        EnergyType m_data_cost;
-        EnergyType m_label_cost;
+
+        // Not part of any index, so they are updated in place
+        mutable bool m_is_active;
+        mutable EnergyType m_data_cost;
+        mutable EnergyType m_label_cost;
 
         Site(VertexDescriptor vertex_desc, LabelType label, bool is_active)
             : m_vertex(vertex_desc)
@@ -52,15 +54,12 @@ class SitesStore
             Site, VertexDescriptor, &Site::m_vertex
           >
         >,
-        boost::multi_index::hashed_non_unique<
+        // Ordered, as relinking a site in a hashed index takes time
+        // linear in the number of sites with the same label
+        boost::multi_index::ordered_non_unique<
           boost::multi_index::member<
             Site, LabelType, &Site::m_label
           >
-        >,
-        boost::multi_index::hashed_non_unique<
-            boost::multi_index::member<
-                Site, bool, &Site::m_is_active
-            >
         >
       >
     > SiteSet;
@@ -70,7 +69,6 @@ public:
     SitesStore()
 		: m_vertex_index(m_sites.template get<0>())
 		, m_label_index(m_sites.template get<1>())
-		, m_active_index(m_sites.template get<2>())
     { }
 
     SitesStore& addVertices(vector<VertexDescriptor>& vertices)
@@ -106,9 +104,7 @@ public:
     SitesStore& assignDataCost(VertexDescriptor vertex_desc, EnergyType data_cost)
     {
         auto it = m_vertex_index.find(vertex_desc);
-        m_vertex_index.modify(it, [data_cost](Site& s) {
-           s.m_data_cost = data_cost;
-        });
+        (*it).m_data_cost = data_cost;
 
         return *this;
     }
@@ -116,14 +112,12 @@ public:
     SitesStore& assignLabelCost(VertexDescriptor vertex_desc, EnergyType label_cost)
     {
         auto it = m_vertex_index.find(vertex_desc);
-        m_vertex_index.modify(it, [label_cost](Site& s) {
-           s.m_label_cost = label_cost;
-        });
+        (*it).m_label_cost = label_cost;
 
         return *this;
     }
 
-    SitesStore& assignLabel(VertexDescriptor vertex_desc, LabelType label, long data_cost)
+    SitesStore& assignLabel(VertexDescriptor vertex_desc, LabelType label, EnergyType data_cost)
     {
         assignLabel(vertex_desc, label);
         assignDataCost(vertex_desc, data_cost);
@@ -134,18 +128,16 @@ public:
     SitesStore& setActive(VertexDescriptor vertex_desc, bool is_active)
     {
         auto it = m_vertex_index.find(vertex_desc);
-        m_vertex_index.modify(it, [is_active](Site& s) {
-           s.m_is_active = is_active;
-        });
+        (*it).m_is_active = is_active;
 
         return *this;
     }
 
     SitesStore& setActiveForLabel(LabelType label, bool is_active)
     {
-        auto it = m_label_index.find(label);
-        for (; it != m_label_index.end(); it++) {
-            setActive((*it).m_vertex, is_active);
+        auto range = m_label_index.equal_range(label);
+        for (auto it = range.first; it != range.second; it++) {
+            (*it).m_is_active = is_active;
         }
 
         return *this;
@@ -156,12 +148,12 @@ public:
         return (*it).m_label;
     }
 
-    int dataCost(VertexDescriptor vertex_desc) {
+    EnergyType dataCost(VertexDescriptor vertex_desc) {
         auto it = m_vertex_index.find(vertex_desc);
         return (*it).m_data_cost;
     }
 
-    int labelCost(VertexDescriptor vertex_desc) {
+    EnergyType labelCost(VertexDescriptor vertex_desc) {
         auto it = m_vertex_index.find(vertex_desc);
         return (*it).m_label_cost;
     }
@@ -231,12 +223,10 @@ public:
 private:
     typedef typename SiteSet::template nth_index<0>::type SitesByVertex;
     typedef typename SiteSet::template nth_index<1>::type SitesByLabel;
-    typedef typename SiteSet::template nth_index<2>::type SitesByActiveFlag;
 
     SiteSet m_sites;
     SitesByVertex& m_vertex_index;
     SitesByLabel& m_label_index;
-    SitesByActiveFlag& m_active_index;
 
     map<LabelType, std::size_t> m_label_counts;
     map<pair<LabelType, LabelType>, int> m_transition_counts;